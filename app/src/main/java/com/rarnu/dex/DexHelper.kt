@@ -6,27 +6,76 @@ import java.io.Closeable
 import java.lang.reflect.Field
 import java.lang.reflect.Member
 
-class DexHelper(private val classLoader: ClassLoader) : Object(), AutoCloseable, Closeable {
+class DexHelper(private val classLoader: ClassLoader, snapshotPath: String? = null, lazy: Boolean = false, noCache: Boolean = false) : Object(), AutoCloseable, Closeable {
 
     companion object {
         @JvmStatic
         val NO_CLASS_INDEX = -1
+
+        const val TYPE_NEW_INSTANCE = 1 shl 0
+        const val TYPE_NEW_ARRAY = 1 shl 1
+        const val TYPE_CHECK_CAST = 1 shl 2
+        const val TYPE_INSTANCE_OF = 1 shl 3
+        const val TYPE_CONST_CLASS = 1 shl 4
+        const val TYPE_FILLED_NEW_ARRAY = 1 shl 5
+        const val TYPE_ANY = (1 shl 6) - 1
     }
 
-    private val token: Long = load(classLoader)
+    private val token: Long = load(classLoader, snapshotPath, lazy, noCache)
 
     external fun findMethodUsingString(str: String, matchPrefix: Boolean, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
 
+    external fun findMethodUsingSubstring(str: String, regex: Boolean, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
+    external fun findMethodUsingSimilarString(str: String, maxDistance: Int, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
+    class StringQuery(val str: String, val matchPrefix: Boolean = false, val returnType: Long = -1, val parameterCount: Short = -1, val parameterShorty: String? = null, val declaringClass: Long = -1, val parameterTypes: LongArray? = null, val containsParameterTypes: LongArray? = null, val findFirst: Boolean = false)
+
+    fun findMethodUsingStrings(queries: List<StringQuery>, dexPriority: IntArray? = null): Array<LongArray> = findMethodUsingStrings(
+        Array(queries.size) { queries[it].str },
+        BooleanArray(queries.size) { queries[it].matchPrefix },
+        LongArray(queries.size) { queries[it].returnType },
+        ShortArray(queries.size) { queries[it].parameterCount },
+        Array(queries.size) { queries[it].parameterShorty },
+        LongArray(queries.size) { queries[it].declaringClass },
+        Array(queries.size) { queries[it].parameterTypes },
+        Array(queries.size) { queries[it].containsParameterTypes },
+        BooleanArray(queries.size) { queries[it].findFirst },
+        dexPriority
+    )
+
+    private external fun findMethodUsingStrings(strs: Array<String>, matchPrefix: BooleanArray, returnType: LongArray, parameterCount: ShortArray, parameterShorty: Array<String?>, declaringClass: LongArray, parameterTypes: Array<LongArray?>, containsParameterTypes: Array<LongArray?>, findFirst: BooleanArray, dexPriority: IntArray?): Array<LongArray>
+
     external fun findMethodInvoking(methodIndex: Long, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
 
     external fun findMethodInvoked(methodIndex: Long, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
 
+    external fun findMethodInvokedByDispatch(methodIndex: Long, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
+    external fun findReachableMethods(methodIndex: Long, maxDepth: Int, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
+    external fun findCallersTransitive(methodIndex: Long, maxDepth: Int, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
     external fun findMethodSettingField(fieldIndex: Long, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
 
     external fun findMethodGettingField(fieldIndex: Long, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
 
+    external fun findMethodUsingType(classIndex: Long, kinds: Int, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
+    external fun findMethodUsingNumber(value: Long, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
+    external fun findMethodUsingNumberRange(lower: Long, upper: Long, returnType: Long, parameterCount: Short, parameterShorty: String?, declaringClass: Long, parameterTypes: LongArray?, containsParameterTypes: LongArray?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
+    external fun findMethodBySignature(returnType: Long, parameterTypes: LongArray?, parameterShorty: String?, dexPriority: IntArray?, findFirst: Boolean): LongArray
+
     external fun findField(type: Long, dexPriority: IntArray?, findFirst: Boolean): LongArray
 
+    external fun findSubclasses(classIndex: Long, transitive: Boolean): LongArray
+
+    external fun findImplementations(interfaceIndex: Long): LongArray
+
+    external fun findSuperclasses(classIndex: Long): LongArray
+
     external fun decodeMethodIndex(methodIndex: Long): Member?
 
     external fun encodeMethodIndex(method: Member): Long
@@ -41,7 +90,23 @@ class DexHelper(private val classLoader: ClassLoader) : Object(), AutoCloseable,
 
     external fun createFullCache()
 
-    private external fun load(classLoader: ClassLoader): Long
+    external fun createGlobalIndices()
+
+    external fun startWarmup(dexPriority: IntArray? = null)
+
+    external fun pauseWarmup()
+
+    external fun resumeWarmup()
+
+    external fun cancelWarmup()
+
+    external fun getWarmupProgress(): Float
+
+    external fun compact()
+
+    external fun saveSnapshot(path: String): Boolean
+
+    private external fun load(classLoader: ClassLoader, snapshotPath: String?, lazy: Boolean, noCache: Boolean): Long
 
     external override fun close()
 
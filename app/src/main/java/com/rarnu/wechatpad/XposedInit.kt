@@ -54,7 +54,7 @@ class XposedInit : IXposedHookLoadPackage {
             }
         }
         if (baseDexClassLoader != null) {
-            val dexHelper = DexHelper(baseDexClassLoader)
+            val dexHelper = DexHelper(baseDexClassLoader, noCache = true)
             val findMethodUsingString = dexHelper.findMethodUsingString("Lenovo TB-9707F", true, -1L, (-1).toShort(), null, -1L, null, null, null, true)
             val methodIdx = if (findMethodUsingString.isEmpty()) null else findMethodUsingString[0]
             if (methodIdx != null) {
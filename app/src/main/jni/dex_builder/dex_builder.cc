@@ -43,7 +43,10 @@ namespace dex {
 
 using std::string;
 
+using ::dex::kAccConstructor;
+using ::dex::kAccPrivate;
 using ::dex::kAccPublic;
+using ::dex::kAccStatic;
 
 const TypeDescriptor TypeDescriptor::Int{"I"};
 const TypeDescriptor TypeDescriptor::Void{"V"};
@@ -353,6 +356,14 @@ ClassBuilder ClassBuilder::setSuperClass(const TypeDescriptor &type) {
     return *this;
 }
 
+ClassBuilder ClassBuilder::addInterface(const TypeDescriptor &type) {
+  if (class_->interfaces == nullptr) {
+    class_->interfaces = parent_->Alloc<ir::TypeList>();
+  }
+  class_->interfaces->types.push_back(parent_->GetOrAddType(type));
+  return *this;
+}
+
 void ClassBuilder::set_source_file(const string &source) {
   class_->source_file = parent_->GetOrAddString(source);
 }
@@ -404,7 +415,12 @@ ir::EncodedMethod *MethodBuilder::Encode() {
   code->outs_count = std::max(return_count, max_args_);
   method->code = code;
 
-  class_->direct_methods.push_back(method);
+  // static, private and constructor methods are direct, the others dispatch virtually
+  if (access_flags_ & (kAccStatic | kAccPrivate | kAccConstructor)) {
+    class_->direct_methods.push_back(method);
+  } else {
+    class_->virtual_methods.push_back(method);
+  }
 
   return method;
 }
@@ -518,6 +534,14 @@ void MethodBuilder::EncodeInstruction(const Instruction &instruction) {
     return EncodeNewArray(instruction);
   case Instruction::Op::kCheckCast:
     return EncodeCast(instruction);
+  case Instruction::Op::kInstanceOf:
+    return EncodeInstanceOf(instruction);
+  case Instruction::Op::kConstClass:
+    return EncodeConstClass(instruction);
+  case Instruction::Op::kFilledNewArray:
+    return EncodeInvoke(instruction, ::dex::Opcode::OP_FILLED_NEW_ARRAY);
+  case Instruction::Op::kFilledNewArrayRange:
+    return EncodeInvokeRange(instruction, ::dex::Opcode::OP_FILLED_NEW_ARRAY_RANGE);
   case Instruction::Op::kGetStaticField:
   case Instruction::Op::kGetStaticObjectField:
   case Instruction::Op::kSetStaticField:
@@ -696,6 +720,31 @@ void MethodBuilder::EncodeCast(const Instruction &instruction) {
             type.value());
 }
 
+void MethodBuilder::EncodeInstanceOf(const Instruction &instruction) {
+  assert(Instruction::Op::kInstanceOf == instruction.opcode());
+  assert(instruction.dest().has_value());
+  assert(instruction.dest()->is_variable());
+  assert(2 == instruction.args().size());
+  const auto &args = instruction.args();
+  const Value &type = args[1];
+  assert(type.is_type());
+  Encode22c(::dex::Opcode::OP_INSTANCE_OF, RegisterValue(*instruction.dest()),
+            RegisterValue(args[0]), type.value());
+}
+
+void MethodBuilder::EncodeConstClass(const Instruction &instruction) {
+  assert(Instruction::Op::kConstClass == instruction.opcode());
+  assert(instruction.dest().has_value());
+  assert(instruction.dest()->is_variable());
+  assert(1 == instruction.args().size());
+
+  const Value &type = instruction.args()[0];
+  assert(RegisterValue(*instruction.dest()) < 256);
+  assert(type.is_type());
+  Encode21c(::dex::Opcode::OP_CONST_CLASS, RegisterValue(*instruction.dest()),
+            type.value());
+}
+
 void MethodBuilder::EncodeNewArray(const Instruction &instruction) {
   assert(Instruction::Op::kNewArray == instruction.opcode());
   assert(instruction.dest().has_value());
@@ -1,17 +1,191 @@
 #include "dex_helper.h"
 
 #include <algorithm>
+#include <atomic>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <utility>
 
 #include "slicer/dex_format.h"
 #include "slicer/dex_leb128.h"
 #include "slicer/reader.h"
 #include "slicer/dex_utf8.h"
+#include "slicer/chronometer.h"
 
 namespace {
-constexpr auto utf8_less = [](const std::string_view a, const std::string_view b) { return dex::Utf8Cmp(a.data(), b.data()) < 0; };
+const char *StringData(const dex::Reader &dex, const dex::StringId &str) {
+    const auto *ptr = dex.dataPtr<dex::u1>(str.string_data_off);
+    dex::ReadULeb128(&ptr);
+    return reinterpret_cast<const char *>(ptr);
+}
+
+// dex strings sort by UTF-16 code unit, which agrees with byte order up to the first
+// non-ASCII byte, so only the differing character is ever decoded
+int CompareString(std::string_view a, std::string_view b) {
+    auto [ia, ib] = std::mismatch(a.begin(), a.end(), b.begin(), b.end());
+    if (ia == a.end() || ib == b.end()) {
+        return (ia != a.end()) - (ib != b.end());
+    }
+    auto ca = static_cast<uint8_t>(*ia);
+    auto cb = static_cast<uint8_t>(*ib);
+    if (ca < 0x80 && cb < 0x80) {
+        return ca - cb;
+    }
+    auto pos = ia - a.begin();
+    while (pos > 0 && (static_cast<uint8_t>(a[pos]) & 0xc0) == 0x80) --pos;
+    return dex::Utf8Cmp(a.data() + pos, b.data() + pos);
+}
+
+// up to 8 leading code units as big endian bytes, 0 padded. the encoded NUL counts as 0 and
+// the first unit above 0x7f as 0xff, which ends the key. so whenever two keys differ they
+// order their strings like CompareString, and equal keys need the full comparison
+uint64_t SortKey(std::string_view str, size_t *key_size = nullptr) {
+    uint64_t key = 0;
+    auto size = 0zu;
+    for (auto i = 0zu; i < str.size() && size < sizeof(key); ++size) {
+        auto c = static_cast<uint8_t>(str[i]);
+        if (c < 0x80) {
+            ++i;
+        } else if (c == 0xc0 && i + 1 < str.size() && static_cast<uint8_t>(str[i + 1]) == 0x80) {
+            c = 0;
+            i += 2;
+        } else {
+            c = 0xff;
+            i = str.size();
+        }
+        key |= uint64_t(c) << (56 - 8 * size);
+    }
+    if (key_size) *key_size = size;
+    return key;
+}
+
+// runs task(0) .. task(count - 1) on up to threads workers
+template <typename Task>
+void RunTasks(size_t count, size_t threads, Task &&task) {
+    threads = std::min(std::max(threads, 1zu), count);
+    if (threads <= 1) {
+        for (auto i = 0zu; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+    std::atomic_size_t next = 0;
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (auto t = 0zu; t < threads; ++t) {
+        workers.emplace_back([&task, &next, count] {
+            for (auto i = next++; i < count; i = next++) {
+                task(i);
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+// offsets + values of posting lists holding each (key, value) entry, values in entry order
+std::pair<std::vector<uint32_t>, std::vector<uint32_t>>
+GroupByKey(size_t key_count, const std::vector<std::pair<uint32_t, uint32_t>> &entries) {
+    std::vector<uint32_t> offsets(key_count + 1, 0);
+    for (const auto &[key, _] : entries) {
+        ++offsets[key + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> values(entries.size());
+    auto next = offsets;
+    for (const auto &[key, value] : entries) {
+        values[next[key]++] = value;
+    }
+    return {std::move(offsets), std::move(values)};
+}
+
+// what the scanner records for an opcode, the operand is always the unit after the opcode
+enum class OpcodeKind : uint8_t {
+    kOther,
+    kConstString,
+    kConstStringJumbo,
+    kGetField,
+    kPutField,
+    kInvoke,
+    kUseType,
+    kConstNumber,
+    kNop,  // may start a payload
+};
+
+struct OpcodeInfo {
+    OpcodeKind kind = OpcodeKind::kOther;
+    uint8_t width = 1;  // in code units, payloads excluded
+    DexHelper::TypeUsage type_usage = DexHelper::kTypeUsageCount;  // of kUseType
+};
+
+constexpr std::array<OpcodeInfo, 256> kOpcodeInfo = [] {
+    std::array<OpcodeInfo, 256> info{};
+    auto set = [&info](uint8_t first, uint8_t last, OpcodeKind kind) {
+        for (auto op = first; op <= last; ++op) info[op].kind = kind;
+    };
+    for (auto op = 0zu; op < info.size(); ++op) info[op].width = dex::opcode_len[op];
+    set(0x00, 0x00, OpcodeKind::kNop);
+    set(0x12, 0x19, OpcodeKind::kConstNumber);  // const*, const-wide*
+    set(0x1a, 0x1a, OpcodeKind::kConstString);
+    set(0x1b, 0x1b, OpcodeKind::kConstStringJumbo);
+    set(0x52, 0x58, OpcodeKind::kGetField);  // iget*
+    set(0x59, 0x5f, OpcodeKind::kPutField);  // iput*
+    set(0x60, 0x66, OpcodeKind::kGetField);  // sget*
+    set(0x67, 0x6d, OpcodeKind::kPutField);  // sput*
+    set(0x6e, 0x72, OpcodeKind::kInvoke);
+    set(0x74, 0x78, OpcodeKind::kInvoke);  // invoke-*/range
+    auto use_type = [&info](uint8_t op, DexHelper::TypeUsage usage) {
+        info[op].kind = OpcodeKind::kUseType;
+        info[op].type_usage = usage;
+    };
+    use_type(0x1c, DexHelper::kConstClass);
+    use_type(0x1f, DexHelper::kCheckCast);
+    use_type(0x20, DexHelper::kInstanceOf);
+    use_type(0x22, DexHelper::kNewInstance);
+    use_type(0x23, DexHelper::kNewArray);
+    use_type(0x24, DexHelper::kFilledNewArray);
+    use_type(0x25, DexHelper::kFilledNewArray);  // filled-new-array/range
+    return info;
+}();
+
+// the value a kConstNumber instruction loads, sign extended like its register gets it
+int64_t DecodeLiteral(const dex::u2 *inst) {
+    auto u4_at = [inst](size_t i) { return inst[i] | uint32_t(inst[i + 1]) << 16; };
+    switch (*inst & 0xff) {
+        case 0x12:  // const/4
+            return static_cast<int16_t>(*inst) >> 12;
+        case 0x13:  // const/16
+        case 0x16:  // const-wide/16
+            return static_cast<int16_t>(inst[1]);
+        case 0x14:  // const
+        case 0x17:  // const-wide/32
+            return static_cast<int32_t>(u4_at(1));
+        case 0x15:  // const/high16
+            return static_cast<int32_t>(uint32_t(inst[1]) << 16);
+        case 0x18:  // const-wide
+            return static_cast<int64_t>(u4_at(1) | uint64_t(u4_at(3)) << 32);
+        case 0x19:  // const-wide/high16
+            return static_cast<int64_t>(uint64_t(inst[1]) << 48);
+        default:
+            return 0;
+    }
+}
+
+// field and method ids are sorted by declaring class, then by name
+struct MemberLess {
+    using Key = std::pair<uint32_t, uint32_t>;
+    template <typename T>
+    bool operator()(const T &a, const Key &b) const { return Key(a.class_idx, a.name_idx) < b; }
+    template <typename T>
+    bool operator()(const Key &a, const T &b) const { return a < Key(b.class_idx, b.name_idx); }
+};
 }  // namespace
 
-DexHelper::DexHelper(const std::vector<std::tuple<const void *, size_t, const void *, size_t>> &dexs) {
+DexHelper::DexHelper(const std::vector<std::tuple<const void *, size_t, const void *, size_t>> &dexs,
+                     size_t threads, std::string_view snapshot_path, bool lazy, bool no_cache)
+    : no_cache_(no_cache) {
     for (const auto &[image, size, data, data_size] : dexs) {
         readers_.emplace_back(static_cast<const dex::u1 *>(image), size, static_cast<const dex::u1 *>(data), data_size);
     }
@@ -23,186 +197,587 @@ DexHelper::DexHelper(const std::vector<std::tuple<const void *, size_t, const vo
     rev_field_indices_.resize(dex_count);
     strings_.resize(dex_count);
     method_codes_.resize(dex_count);
+    method_columns_.resize(dex_count);
     string_cache_.resize(dex_count);
-    type_cache_.resize(dex_count);
-    field_cache_.resize(dex_count);
-    method_cache_.resize(dex_count);
     class_cache_.resize(dex_count);
     invoking_cache_.resize(dex_count);
     invoked_cache_.resize(dex_count);
     getting_cache_.resize(dex_count);
     setting_cache_.resize(dex_count);
+    type_cache_.resize(dex_count);
+    number_cache_.resize(dex_count);
     declaring_cache_.resize(dex_count);
+    shorty_cache_.resize(dex_count);
+    parameter_cache_.resize(dex_count);
+    proto_cache_.resize(dex_count);
+    trigram_cache_.resize(dex_count);
+    subclass_cache_.resize(dex_count);
+    implementation_cache_.resize(dex_count);
+    override_cache_.resize(dex_count);
+    method_declarations_.resize(dex_count);
     searched_methods_.resize(dex_count);
-
+    build_times_.resize(dex_count);
+    built_ = std::make_unique<std::once_flag[]>(dex_count);
+    trigrams_built_ = std::make_unique<std::once_flag[]>(dex_count);
+    trigrams_ready_ = std::make_unique<std::atomic_bool[]>(dex_count);
+    hierarchy_built_ = std::make_unique<std::once_flag[]>(dex_count);
+    hierarchy_ready_ = std::make_unique<std::atomic_bool[]>(dex_count);
+    ready_ = std::make_unique<std::atomic_bool[]>(dex_count);
+    dex_locks_ = std::make_unique<std::shared_mutex[]>(dex_count);
+    fully_scanned_ = std::make_unique<std::atomic_bool[]>(dex_count);
+    method_indices_.set_width(dex_count);
+    class_indices_.set_width(dex_count);
+    field_indices_.set_width(dex_count);
+    // index creation spans all dexs, so its reverse maps exist even for dexs not built yet
     for (auto dex_idx = 0zu; dex_idx < dex_count; ++dex_idx) {
-        auto &dex = readers_[dex_idx];
+        const auto &dex = readers_[dex_idx];
         rev_method_indices_[dex_idx].resize(dex.MethodIds().size(), size_t(-1));
         rev_class_indices_[dex_idx].resize(dex.TypeIds().size(), size_t(-1));
         rev_field_indices_[dex_idx].resize(dex.FieldIds().size(), size_t(-1));
+    }
 
-        strings_[dex_idx].reserve(dex.StringIds().size());
-        method_codes_[dex_idx].resize(dex.MethodIds().size(), nullptr);
+    if (!snapshot_path.empty()) LoadSnapshot(snapshot_path);
+    if (lazy) return;
 
-        type_cache_[dex_idx].resize(dex.StringIds().size(), dex::kNoIndex);
-        field_cache_[dex_idx].resize(dex.TypeIds().size());
-        method_cache_[dex_idx].resize(dex.TypeIds().size());
-        class_cache_[dex_idx].resize(dex.TypeIds().size(), dex::kNoIndex);
+    // every dex only touches its own slot of the tables above, so they can be built in parallel
+    RunTasks(dex_count, threads, [this](size_t dex_idx) { EnsureDex(dex_idx); });
+}
 
-        string_cache_[dex_idx].resize(dex.StringIds().size());
-        invoking_cache_[dex_idx].resize(dex.MethodIds().size());
-        invoked_cache_[dex_idx].resize(dex.MethodIds().size());
-        getting_cache_[dex_idx].resize(dex.FieldIds().size());
-        setting_cache_[dex_idx].resize(dex.FieldIds().size());
-        declaring_cache_[dex_idx].resize(dex.TypeIds().size());
+void DexHelper::EnsureDex(size_t dex_idx) const {
+    // the tables of a dex are only written here, before anything can read them
+    std::call_once(built_[dex_idx], [this, dex_idx] {
+        const_cast<DexHelper *>(this)->BuildDex(dex_idx);
+    });
+}
 
-        searched_methods_[dex_idx].resize(dex.MethodIds().size());
+void DexHelper::BuildDex(size_t dex_idx) {
+    slicer::Chronometer chronometer(build_times_[dex_idx]);
+    if (snapshot_) {
+        // everything is mapped and fully cached already
+        searched_methods_[dex_idx].assign(readers_[dex_idx].MethodIds().size(), true);
+        fully_scanned_[dex_idx].store(true, std::memory_order_release);
+    } else {
+        InitDex(dex_idx);
     }
+    ready_[dex_idx].store(true, std::memory_order_release);
+}
 
-    for (auto dex_idx = 0zu; dex_idx < dex_count; ++dex_idx) {
-        auto &dex = readers_[dex_idx];
-        auto &strs = strings_[dex_idx];
-        for (const auto &str : dex.StringIds()) {
-            const auto *ptr = dex.dataPtr<dex::u1>(str.string_data_off);
-            dex::ReadULeb128(&ptr);
-            strs.emplace_back(reinterpret_cast<const char *>(ptr));
-        }
+void DexHelper::InitDex(size_t dex_idx) {
+    auto &dex = readers_[dex_idx];
+    searched_methods_[dex_idx].resize(dex.MethodIds().size());
+
+    string_cache_[dex_idx].resize(dex.StringIds().size());
+    invoking_cache_[dex_idx].resize(dex.MethodIds().size());
+    invoked_cache_[dex_idx].resize(dex.MethodIds().size());
+    getting_cache_[dex_idx].resize(dex.FieldIds().size());
+    setting_cache_[dex_idx].resize(dex.FieldIds().size());
+    type_cache_[dex_idx].resize(dex.TypeIds().size() * kTypeUsageCount);
+
+    const auto *base = reinterpret_cast<const char *>(dex.DataBegin());
+    std::vector<StringRef> strs;
+    std::vector<uint64_t> keys;
+    strs.reserve(dex.StringIds().size());
+    keys.reserve(dex.StringIds().size());
+    for (const auto &str : dex.StringIds()) {
+        std::string_view chars = StringData(dex, str);
+        strs.push_back({static_cast<uint32_t>(chars.data() - base), static_cast<uint32_t>(chars.size())});
+        keys.push_back(SortKey(chars));
     }
+    strings_[dex_idx].assign(base, std::move(strs), std::move(keys));
 
-    for (auto dex_idx = 0zu; dex_idx < dex_count; ++dex_idx) {
-        auto &dex = readers_[dex_idx];
-        for (auto class_idx = 0zu; class_idx < dex.ClassDefs().size(); ++class_idx) {
-            const auto &class_def = dex.ClassDefs()[class_idx];
-            class_cache_[dex_idx][class_def.class_idx] = class_idx;
-            if (class_def.class_data_off == 0) continue;
-            const auto *class_data = dex.dataPtr<dex::u1>(class_def.class_data_off);
-            dex::u4 static_fields_count = dex::ReadULeb128(&class_data);
-            dex::u4 instance_fields_count = dex::ReadULeb128(&class_data);
-            dex::u4 direct_methods_count = dex::ReadULeb128(&class_data);
-            dex::u4 virtual_methods_count = dex::ReadULeb128(&class_data);
+    std::vector<uint32_t> codes(dex.MethodIds().size(), 0);
+    std::vector<uint32_t> classes(dex.TypeIds().size(), dex::kNoIndex);
+    for (auto class_idx = 0zu; class_idx < dex.ClassDefs().size(); ++class_idx) {
+        const auto &class_def = dex.ClassDefs()[class_idx];
+        classes[class_def.class_idx] = class_idx;
+        if (class_def.class_data_off == 0) continue;
+        const auto *class_data = dex.dataPtr<dex::u1>(class_def.class_data_off);
+        dex::u4 static_fields_count = dex::ReadULeb128(&class_data);
+        dex::u4 instance_fields_count = dex::ReadULeb128(&class_data);
+        dex::u4 direct_methods_count = dex::ReadULeb128(&class_data);
+        dex::u4 virtual_methods_count = dex::ReadULeb128(&class_data);
 
-            auto &codes = method_codes_[dex_idx];
-            codes.resize(dex.MethodIds().size(), nullptr);
+        for (dex::u4 i = 0; i < static_fields_count; ++i) {
+            dex::ReadULeb128(&class_data);
+            dex::ReadULeb128(&class_data);
+        }
 
-            for (dex::u4 i = 0; i < static_fields_count; ++i) {
-                dex::ReadULeb128(&class_data);
-                dex::ReadULeb128(&class_data);
-            }
+        for (dex::u4 i = 0; i < instance_fields_count; ++i) {
+            dex::ReadULeb128(&class_data);
+            dex::ReadULeb128(&class_data);
+        }
 
-            for (dex::u4 i = 0; i < instance_fields_count; ++i) {
-                dex::ReadULeb128(&class_data);
-                dex::ReadULeb128(&class_data);
-            }
+        for (dex::u4 i = 0, method_idx = 0; i < direct_methods_count; ++i) {
+            method_idx += dex::ReadULeb128(&class_data);
+            dex::ReadULeb128(&class_data);
+            codes[method_idx] = dex::ReadULeb128(&class_data);
+        }
 
-            for (dex::u4 i = 0, method_idx = 0; i < direct_methods_count; ++i) {
-                method_idx += dex::ReadULeb128(&class_data);
-                dex::ReadULeb128(&class_data);
-                auto offset = dex::ReadULeb128(&class_data);
-                if (offset != 0) {
-                    codes[method_idx] = dex.dataPtr<const dex::CodeItem>(offset);
-                }
-            }
+        for (dex::u4 i = 0, method_idx = 0; i < virtual_methods_count; ++i) {
+            method_idx += dex::ReadULeb128(&class_data);
+            dex::ReadULeb128(&class_data);
+            codes[method_idx] = dex::ReadULeb128(&class_data);
+        }
+    }
+    method_codes_[dex_idx].assign(std::move(codes));
+    class_cache_[dex_idx].assign(std::move(classes));
 
-            for (dex::u4 i = 0, method_idx = 0; i < virtual_methods_count; ++i) {
-                method_idx += dex::ReadULeb128(&class_data);
-                dex::ReadULeb128(&class_data);
-                auto offset = dex::ReadULeb128(&class_data);
-                if (offset != 0) {
-                    codes[method_idx] = dex.dataPtr<dex::CodeItem>(offset);
-                }
+    const auto method_count = dex.MethodIds().size();
+    std::vector<uint16_t> class_ids(method_count);
+    std::vector<uint16_t> return_types(method_count);
+    std::vector<uint16_t> parameter_counts(method_count);
+    std::vector<uint16_t> first_parameters(method_count);
+    std::vector<uint32_t> shorty_ids(method_count);
+    for (auto method_idx = 0zu; method_idx < method_count; ++method_idx) {
+        const auto &method = dex.MethodIds()[method_idx];
+        const auto &proto = dex.ProtoIds()[method.proto_idx];
+        const auto *params = proto.parameters_off ? dex.dataPtr<dex::TypeList>(proto.parameters_off) : nullptr;
+        class_ids[method_idx] = method.class_idx;
+        return_types[method_idx] = proto.return_type_idx;
+        parameter_counts[method_idx] = params ? params->size : 0;
+        first_parameters[method_idx] = params && params->size ? params->list[0].type_idx : uint16_t(-1);
+        shorty_ids[method_idx] = proto.shorty_idx;
+    }
+    auto &columns = method_columns_[dex_idx];
+    columns.class_ids.assign(std::move(class_ids));
+    columns.return_types.assign(std::move(return_types));
+    columns.parameter_counts.assign(std::move(parameter_counts));
+    columns.first_parameters.assign(std::move(first_parameters));
+    columns.shorties.assign(std::move(shorty_ids));
+
+    // these never grow, so they are laid out frozen right away
+    std::vector<std::pair<uint32_t, uint32_t>> declares;
+    declares.reserve(dex.FieldIds().size());
+    for (auto field_idx = 0zu; field_idx < dex.FieldIds().size(); ++field_idx) {
+        declares.emplace_back(dex.FieldIds()[field_idx].type_idx, field_idx);
+    }
+    auto [declare_offsets, declare] = GroupByKey(dex.TypeIds().size(), declares);
+    declaring_cache_[dex_idx].assign(std::move(declare_offsets), std::move(declare));
+
+    std::vector<std::pair<uint32_t, uint32_t>> shorties;
+    std::vector<std::pair<uint32_t, uint32_t>> parameters;
+    shorties.reserve(dex.ProtoIds().size());
+    for (auto proto_idx = 0zu; proto_idx < dex.ProtoIds().size(); ++proto_idx) {
+        const auto &proto = dex.ProtoIds()[proto_idx];
+        shorties.emplace_back(proto.shorty_idx, proto_idx);
+        if (!proto.parameters_off) continue;
+        const auto *params = dex.dataPtr<dex::TypeList>(proto.parameters_off);
+        for (auto i = 0zu; i < params->size; ++i) {
+            const auto type_idx = params->list[i].type_idx;
+            // a proto is listed once under each of its parameter types
+            if (std::any_of(params->list, params->list + i,
+                            [type_idx](const dex::TypeItem &t) { return t.type_idx == type_idx; })) {
+                continue;
             }
+            parameters.emplace_back(type_idx, proto_idx);
         }
     }
-    for (auto dex_idx = 0zu; dex_idx < dex_count; ++dex_idx) {
-        auto &dex = readers_[dex_idx];
-        auto &type = type_cache_[dex_idx];
-        auto &field = field_cache_[dex_idx];
-        auto &declare = declaring_cache_[dex_idx];
-        auto &method = method_cache_[dex_idx];
-        for (auto type_idx = 0zu; type_idx < dex.TypeIds().size(); ++type_idx) {
-            type[dex.TypeIds()[type_idx].descriptor_idx] = type_idx;
-        }
-        for (auto field_idx = 0zu; field_idx < dex.FieldIds().size(); ++field_idx) {
-            auto f = dex.FieldIds()[field_idx];
-            field[f.class_idx][f.name_idx] = field_idx;
-            declare[f.type_idx].emplace_back(field_idx);
-        }
-        for (auto method_idx = 0zu; method_idx < dex.MethodIds().size(); ++method_idx) {
-            auto m = dex.MethodIds()[method_idx];
-            method[m.class_idx][m.name_idx].emplace_back(method_idx);
-        }
+    auto [shorty_offsets, shorty] = GroupByKey(dex.StringIds().size(), shorties);
+    shorty_cache_[dex_idx].assign(std::move(shorty_offsets), std::move(shorty));
+    auto [parameter_offsets, parameter] = GroupByKey(dex.TypeIds().size(), parameters);
+    parameter_cache_[dex_idx].assign(std::move(parameter_offsets), std::move(parameter));
+
+    std::vector<std::pair<uint32_t, uint32_t>> protos;
+    protos.reserve(dex.MethodIds().size());
+    for (auto method_idx = 0zu; method_idx < dex.MethodIds().size(); ++method_idx) {
+        protos.emplace_back(dex.MethodIds()[method_idx].proto_idx, method_idx);
+    }
+    auto [proto_offsets, proto] = GroupByKey(dex.ProtoIds().size(), protos);
+    proto_cache_[dex_idx].assign(std::move(proto_offsets), std::move(proto));
+}
+
+auto DexHelper::LockDex(size_t dex_idx) const -> DexLock {
+    return {dex_locks_[dex_idx], no_cache_ || fully_scanned_[dex_idx].load(std::memory_order_acquire)};
+}
+
+size_t DexHelper::IndexTable::push_back(std::span<const Member> members) {
+    auto [block, offset] = Locate(first_members_, member_count_);
+    // a row that does not fit the rest of the block starts the next one, which is at least
+    // as large as any row
+    if (offset != 0 && offset + members.size() > first_members_ << block) {
+        member_count_ += (first_members_ << block) - offset;
+        std::tie(block, offset) = std::pair(block + 1, 0zu);
+    }
+    if (!members_[block]) members_[block] = std::make_unique<Member[]>(first_members_ << block);
+    std::copy(members.begin(), members.end(), members_[block].get() + offset);
+
+    auto index = size_.load(std::memory_order_relaxed);
+    auto [row_block, row_offset] = Locate(kFirstBlockSize, index);
+    if (row_offset == 0) rows_[row_block] = std::make_unique<RowRef[]>(kFirstBlockSize << row_block);
+    rows_[row_block][row_offset] = {static_cast<uint32_t>(member_count_),
+                                    static_cast<uint32_t>(members.size())};
+    member_count_ += members.size();
+    size_.store(index + 1, std::memory_order_release);
+    return index;
+}
+
+uint32_t DexHelper::StringPool::LowerBound(std::string_view str) const {
+    auto key = SortKey(str);
+    return std::partition_point(refs_.begin(), refs_.end(), [&](const StringRef &ref) {
+               auto i = &ref - refs_.begin();
+               if (keys_[i] != key) return keys_[i] < key;
+               return CompareString((*this)[i], str) < 0;
+           }) - refs_.begin();
+}
+
+uint32_t DexHelper::StringPool::PrefixUpperBound(std::string_view prefix) const {
+    // strings starting with prefix share its key bytes, whatever follows them
+    auto key_size = 0zu;
+    auto key = SortKey(prefix, &key_size);
+    auto mask = key_size ? ~0ull << (64 - 8 * key_size) : 0ull;
+    return std::partition_point(refs_.begin(), refs_.end(), [&](const StringRef &ref) {
+               auto i = &ref - refs_.begin();
+               if (auto masked = keys_[i] & mask; masked != key) return masked < key;
+               auto str = (*this)[i];
+               return str.starts_with(prefix) || CompareString(str, prefix) < 0;
+           }) - refs_.begin();
+}
+
+void DexHelper::PostingLists::Freeze() {
+    // nothing to freeze if already frozen or never built
+    if (offsets_ || lists_.empty()) return;
+    std::vector<uint32_t> offsets;
+    offsets.reserve(lists_.size() + 1);
+    offsets.emplace_back(0);
+    for (const auto &list : lists_) {
+        offsets.emplace_back(offsets.back() + list.size());
+    }
+    std::vector<uint32_t> values;
+    values.reserve(offsets.back());
+    for (const auto &list : lists_) {
+        values.insert(values.end(), list.begin(), list.end());
+    }
+    assign(std::move(offsets), std::move(values));
+}
+
+void DexHelper::PostingLists::Thaw() {
+    lists_.resize(frozen_size_);
+    for (auto key = 0zu; key < frozen_size_; ++key) {
+        lists_[key].assign(values_ + offsets_[key], values_ + offsets_[key + 1]);
+    }
+    owned_offsets_ = decltype(owned_offsets_)();
+    owned_values_ = decltype(owned_values_)();
+    offsets_ = values_ = nullptr;
+    frozen_size_ = 0;
+}
+
+size_t DexHelper::PostingLists::MemoryUsage() const {
+    auto usage = lists_.capacity() * sizeof(std::vector<uint32_t>) +
+                 (owned_offsets_.capacity() + owned_values_.capacity()) * sizeof(uint32_t);
+    for (const auto &list : lists_) {
+        usage += list.capacity() * sizeof(uint32_t);
     }
+    return usage;
+}
+
+std::pair<size_t, size_t> DexHelper::NumberLists::Find(int64_t lower, int64_t upper,
+                                                      bool *sorted) const {
+    *sorted = sorted_;
+    if (!sorted_) return {0, size_};
+    return {std::lower_bound(values_, values_ + size_, lower) - values_,
+            std::upper_bound(values_, values_ + size_, upper) - values_};
+}
+
+auto DexHelper::NumberLists::Sorted() const
+    -> std::pair<std::vector<int64_t>, std::vector<uint32_t>> {
+    std::vector<uint32_t> order(size_);
+    std::iota(order.begin(), order.end(), 0);
+    if (!sorted_) {
+        std::stable_sort(order.begin(), order.end(),
+                         [this](uint32_t a, uint32_t b) { return values_[a] < values_[b]; });
+    }
+    std::vector<int64_t> values(size_);
+    std::vector<uint32_t> method_ids(size_);
+    for (auto i = 0zu; i < size_; ++i) {
+        values[i] = values_[order[i]];
+        method_ids[i] = method_ids_[order[i]];
+    }
+    return {std::move(values), std::move(method_ids)};
+}
+
+void DexHelper::NumberLists::Freeze() {
+    if (sorted_) return;
+    std::tie(owned_values_, owned_method_ids_) = Sorted();
+    values_ = owned_values_.data();
+    method_ids_ = owned_method_ids_.data();
+    sorted_ = true;
+}
+
+void DexHelper::NumberLists::Own() {
+    owned_values_.assign(values_, values_ + size_);
+    owned_method_ids_.assign(method_ids_, method_ids_ + size_);
+    owned_ = true;
+}
+
+size_t DexHelper::NumberLists::MemoryUsage() const {
+    return owned_values_.capacity() * sizeof(int64_t) +
+           owned_method_ids_.capacity() * sizeof(uint32_t);
 }
 
 std::tuple<uint32_t, uint32_t> DexHelper::FindPrefixStringId(size_t dex_idx,
                                                              std::string_view to_find) const {
     const auto &strs = strings_[dex_idx];
-    if (auto str_lower_bound = std::lower_bound(strs.cbegin(), strs.cend(), to_find, utf8_less),
-        str_upper_bound =
-            std::upper_bound(strs.cbegin(), strs.cend(), std::string(to_find) + '\xff', utf8_less);
-        str_upper_bound != strs.cend() && str_lower_bound != strs.cend() &&
-        str_lower_bound <= str_upper_bound) {
-        return {str_lower_bound - strs.cbegin(), str_upper_bound - strs.cbegin()};
+    if (auto str_lower_bound = strs.LowerBound(to_find), str_upper_bound = strs.PrefixUpperBound(to_find);
+        str_lower_bound < str_upper_bound) {
+        return {str_lower_bound, str_upper_bound};
     }
     return {dex::kNoIndex, dex::kNoIndex};
 }
 
 uint32_t DexHelper::FindPrefixStringIdExact(size_t dex_idx, std::string_view to_find) const {
-    const auto &strs = strings_[dex_idx];
-    auto first = std::lower_bound(strs.cbegin(), strs.cend(), to_find, utf8_less);
-    if (first != strs.cend() && *first == to_find) {
-        return first - strs.cbegin();
+    if (ready_[dex_idx].load(std::memory_order_acquire)) {
+        const auto &strs = strings_[dex_idx];
+        auto first = strs.LowerBound(to_find);
+        if (first != strs.size() && strs[first] == to_find) {
+            return first;
+        }
+        return dex::kNoIndex;
+    }
+    const auto &dex = readers_[dex_idx];
+    const auto &strs = dex.StringIds();
+    uint32_t first = std::lower_bound(strs.begin(), strs.end(), to_find,
+                                      [&dex](const dex::StringId &a, std::string_view b) {
+                                          return CompareString(StringData(dex, a), b) < 0;
+                                      }) - strs.begin();
+    if (first != strs.size() && StringData(dex, strs[first]) == to_find) {
+        return first;
     }
     return dex::kNoIndex;
 }
 
-void DexHelper::CreateFullCache() const {
+std::string_view DexHelper::GetString(size_t dex_idx, uint32_t str_id) const {
+    const auto &dex = readers_[dex_idx];
+    return StringData(dex, dex.StringIds()[str_id]);
+}
+
+uint32_t DexHelper::FindTypeId(size_t dex_idx, uint32_t str_id) const {
+    const auto &types = readers_[dex_idx].TypeIds();
+    auto type = std::lower_bound(types.begin(), types.end(), str_id,
+                                 [](const dex::TypeId &a, uint32_t b) { return a.descriptor_idx < b; });
+    if (type != types.end() && type->descriptor_idx == str_id) {
+        return type - types.begin();
+    }
+    return dex::kNoIndex;
+}
+
+void DexHelper::CreateFullCache(size_t threads) const {
+    RunTasks(readers_.size(), threads, [this](size_t dex_idx) { EnsureDex(dex_idx); });
+    if (threads <= 1) {
+        for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+            if (fully_scanned_[dex_idx].load(std::memory_order_acquire)) continue;
+            std::lock_guard lock(dex_locks_[dex_idx]);
+            const auto &codes = method_codes_[dex_idx];
+            for (auto method_id = 0zu; method_id < codes.size(); ++method_id) {
+                ScanMethod(dex_idx, method_id);
+            }
+            fully_scanned_[dex_idx].store(true, std::memory_order_release);
+        }
+        return;
+    }
+
+    // literals are kept apart, so the other relations need no 64-bit keys
+    struct Shard {
+        std::array<std::vector<std::pair<uint32_t, uint32_t>>, kUsingNumber> lists;
+        std::vector<std::pair<int64_t, uint32_t>> numbers;
+    };
     for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
-        const auto &codes = method_codes_[dex_idx];
-        for (auto method_id = 0zu; method_id < codes.size(); ++method_id) {
-            ScanMethod(dex_idx, method_id);
+        if (fully_scanned_[dex_idx].load(std::memory_order_acquire)) continue;
+        std::lock_guard lock(dex_locks_[dex_idx]);
+        auto &scanned = searched_methods_[dex_idx];
+        auto method_count = method_codes_[dex_idx].size();
+        // a few ranges per worker to even out methods of very different sizes
+        auto range_count = std::min(threads * 4, std::max(method_count, 1zu));
+        auto range_size = (method_count + range_count - 1) / range_count;
+        std::vector<Shard> shards(range_count);
+        // workers only read scanned, it is written after they are done
+        RunTasks(range_count, threads, [&](size_t range) {
+            auto &shard = shards[range];
+            auto end = std::min((range + 1) * range_size, method_count);
+            for (auto method_id = range * range_size; method_id < end; ++method_id) {
+                if (scanned[method_id]) continue;
+                ScanCode(dex_idx, method_id,
+                         [&shard](ScanRelation relation, uint64_t key, uint32_t value) {
+                             if (relation == kUsingNumber) {
+                                 shard.numbers.emplace_back(static_cast<int64_t>(key), value);
+                             } else {
+                                 shard.lists[relation].emplace_back(key, value);
+                             }
+                         });
+            }
+        });
+        // appending the shards in range order keeps every list in the order a serial scan gives
+        auto caches = GetScanCaches(dex_idx);
+        RunTasks(kScanRelationCount, threads, [&](size_t relation) {
+            for (const auto &shard : shards) {
+                if (relation == kUsingNumber) {
+                    for (const auto &[number, value] : shard.numbers) {
+                        caches.numbers->emplace_back(number, value);
+                    }
+                    continue;
+                }
+                for (const auto &[key, value] : shard.lists[relation]) {
+                    caches.lists[relation]->emplace_back(key, value);
+                }
+            }
+        });
+        scanned.assign(method_count, true);
+        fully_scanned_[dex_idx].store(true, std::memory_order_release);
+    }
+}
+
+void DexHelper::StartWarmup(const std::vector<size_t> &dex_priority) const {
+    std::lock_guard lock(warmup_mutex_);
+    if (warmup_.joinable()) {
+        // the last thing a warmup does is completing its progress, it is done after that
+        if (warmup_progress_ < warmup_total_) return;
+        warmup_.join();
+    }
+    auto dex_order = GetPriority(dex_priority);
+    auto total = 0zu;
+    for (auto dex_idx : dex_order) {
+        total += readers_[dex_idx].MethodIds().size();
+    }
+    warmup_paused_ = false;
+    warmup_cancelled_ = false;
+    warmup_progress_ = 0;
+    warmup_total_ = total;
+    warmup_ = std::thread([this, dex_order = std::move(dex_order)] { Warmup(dex_order); });
+}
+
+void DexHelper::PauseWarmup() const {
+    std::lock_guard lock(warmup_mutex_);
+    warmup_paused_ = true;
+}
+
+void DexHelper::ResumeWarmup() const {
+    {
+        std::lock_guard lock(warmup_mutex_);
+        warmup_paused_ = false;
+    }
+    warmup_resumed_.notify_all();
+}
+
+void DexHelper::CancelWarmup() const {
+    std::thread warmup;
+    {
+        std::lock_guard lock(warmup_mutex_);
+        warmup_cancelled_ = true;
+        warmup = std::move(warmup_);
+    }
+    warmup_resumed_.notify_all();
+    if (warmup.joinable()) warmup.join();
+}
+
+std::tuple<size_t, size_t> DexHelper::GetWarmupProgress() const {
+    return {warmup_progress_.load(), warmup_total_.load()};
+}
+
+void DexHelper::Warmup(const std::vector<size_t> &dex_order) const {
+    // the dex lock is only held for a chunk at a time, so queries wait for one chunk at most
+    static constexpr size_t kChunkSize = 1024;
+    for (auto dex_idx : dex_order) {
+        EnsureDex(dex_idx);
+        const auto method_count = method_codes_[dex_idx].size();
+        if (fully_scanned_[dex_idx].load(std::memory_order_acquire)) {
+            warmup_progress_ += method_count;
+            continue;
+        }
+        for (auto begin = 0zu; begin < method_count; begin += kChunkSize) {
+            {
+                std::unique_lock lock(warmup_mutex_);
+                warmup_resumed_.wait(lock, [this] { return !warmup_paused_ || warmup_cancelled_; });
+                if (warmup_cancelled_) return;
+            }
+            auto end = std::min(begin + kChunkSize, method_count);
+            std::lock_guard lock(dex_locks_[dex_idx]);
+            for (auto method_id = begin; method_id < end; ++method_id) {
+                ScanMethod(dex_idx, method_id);
+            }
+            if (end == method_count) {
+                fully_scanned_[dex_idx].store(true, std::memory_order_release);
+            }
+            warmup_progress_ += end - begin;
         }
     }
 }
 
-bool DexHelper::ScanMethod(size_t dex_idx, uint32_t method_id, size_t str_lower,
-                           size_t str_upper) const {
-    static constexpr dex::u1 kOpcodeMask = 0xff;
-    static constexpr dex::u1 kOpcodeNoOp = 0x00;
-    static constexpr dex::u1 kOpcodeConstString = 0x1a;
-    static constexpr dex::u1 kOpcodeConstStringJumbo = 0x1b;
-    static constexpr dex::u1 kOpcodeIGetStart = 0x52;
-    static constexpr dex::u1 kOpcodeIGetEnd = 0x58;
-    static constexpr dex::u1 kOpcodeSGetStart = 0x60;
-    static constexpr dex::u1 kOpcodeSGetEnd = 0x66;
-    static constexpr dex::u1 kOpcodeIPutStart = 0x59;
-    static constexpr dex::u1 kOpcodeIPutEnd = 0x5f;
-    static constexpr dex::u1 kOpcodeSPutStart = 0x67;
-    static constexpr dex::u1 kOpcodeSPutEnd = 0x6d;
-    static constexpr dex::u1 kOpcodeInvokeStart = 0x6e;
-    static constexpr dex::u1 kOpcodeInvokeEnd = 0x72;
-    static constexpr dex::u1 kOpcodeInvokeRangeStart = 0x74;
-    static constexpr dex::u1 kOpcodeInvokeRangeEnd = 0x78;
+void DexHelper::Compact() const {
+    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+        // a lazy dex may be filling its caches under call_once only, the lock does not cover it
+        if (!ready_[dex_idx].load(std::memory_order_acquire)) continue;
+        std::lock_guard lock(dex_locks_[dex_idx]);
+        string_cache_[dex_idx].Freeze();
+        invoking_cache_[dex_idx].Freeze();
+        invoked_cache_[dex_idx].Freeze();
+        getting_cache_[dex_idx].Freeze();
+        setting_cache_[dex_idx].Freeze();
+        type_cache_[dex_idx].Freeze();
+        number_cache_[dex_idx].Freeze();
+    }
+}
+
+size_t DexHelper::GetCacheMemoryUsage() const {
+    auto usage = 0zu;
+    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+        // a lazy dex counts once it is built, as in Compact
+        if (!ready_[dex_idx].load(std::memory_order_acquire)) continue;
+        std::shared_lock lock(dex_locks_[dex_idx]);
+        usage += string_cache_[dex_idx].MemoryUsage() + invoking_cache_[dex_idx].MemoryUsage() +
+                 invoked_cache_[dex_idx].MemoryUsage() + getting_cache_[dex_idx].MemoryUsage() +
+                 setting_cache_[dex_idx].MemoryUsage() + type_cache_[dex_idx].MemoryUsage() +
+                 number_cache_[dex_idx].MemoryUsage() +
+                 declaring_cache_[dex_idx].MemoryUsage() +
+                 shorty_cache_[dex_idx].MemoryUsage() + parameter_cache_[dex_idx].MemoryUsage() +
+                 proto_cache_[dex_idx].MemoryUsage();
+        // built on first use, and counted once it is
+        if (trigrams_ready_[dex_idx].load(std::memory_order_acquire)) {
+            usage += trigram_cache_[dex_idx].MemoryUsage();
+        }
+        if (hierarchy_ready_[dex_idx].load(std::memory_order_acquire)) {
+            usage += subclass_cache_[dex_idx].MemoryUsage() +
+                     implementation_cache_[dex_idx].MemoryUsage() +
+                     override_cache_[dex_idx].size() * sizeof(uint32_t) +
+                     method_declarations_[dex_idx].capacity() * sizeof(MethodDeclaration);
+        }
+    }
+    return usage;
+}
+
+auto DexHelper::GetScanCaches(size_t dex_idx) const -> ScanCaches {
+    return {{&string_cache_[dex_idx], &invoking_cache_[dex_idx], &invoked_cache_[dex_idx],
+             &getting_cache_[dex_idx], &setting_cache_[dex_idx], &type_cache_[dex_idx]},
+            &number_cache_[dex_idx]};
+}
+
+bool DexHelper::ScanMethod(size_t dex_idx, uint32_t method_id, const IdRanges &strings) const {
+    auto &scanned = searched_methods_[dex_idx];
+    if (scanned[method_id]) {
+        return false;
+    }
+    scanned[method_id] = true;
+    auto caches = GetScanCaches(dex_idx);
+    bool match_str = false;
+    ScanCode(dex_idx, method_id, [&](ScanRelation relation, uint64_t key, uint32_t value) {
+        caches.emplace_back(relation, key, value);
+        if (relation == kUsingString && !match_str) {
+            match_str = InRanges(strings, static_cast<uint32_t>(key));
+        }
+    });
+    return match_str;
+}
+
+template <unsigned kRelations, typename Emit>
+void DexHelper::ScanCode(size_t dex_idx, uint32_t method_id, Emit &&emit) const {
     static constexpr dex::u2 kInstPackedSwitchPlayLoad = 0x0100;
     static constexpr dex::u2 kInstSparseSwitchPlayLoad = 0x0200;
     static constexpr dex::u2 kInstFillArrayDataPlayLoad = 0x0300;
     auto &dex = readers_[dex_idx];
-    auto &str_cache = string_cache_[dex_idx];
-    auto &inv_cache = invoking_cache_[dex_idx];
-    auto &inved_cache = invoked_cache_[dex_idx];
-    auto &get_cache = getting_cache_[dex_idx];
-    auto &set_cache = setting_cache_[dex_idx];
-    auto &scanned = searched_methods_[dex_idx];
 
-    bool match_str = false;
-    if (scanned[method_id]) {
-        return match_str;
-    }
-    scanned[method_id] = true;
-    const auto &code = method_codes_[dex_idx][method_id];
-    if (!code) {
-        return match_str;
+    const auto code_off = method_codes_[dex_idx][method_id];
+    if (!code_off) {
+        return;
     }
+    const auto *code = dex.dataPtr<dex::CodeItem>(code_off);
     const dex::u2 *inst;
     const dex::u2 *end;
     if (dex.IsCompact()) {
@@ -222,49 +797,74 @@ bool DexHelper::ScanMethod(size_t dex_idx, uint32_t method_id, size_t str_lower,
         end = inst + reinterpret_cast<const dex::Code*>(code)->insns_size;
     }
     while (inst < end) {
-        dex::u1 opcode = *inst & kOpcodeMask;
-        if (opcode == kOpcodeConstString) {
-            auto str_idx = inst[1];
-            if (str_lower <= str_idx && str_upper > str_idx) {
-                match_str = true;
-            }
-            str_cache[str_idx].emplace_back(method_id);
-        }
-        if (opcode == kOpcodeConstStringJumbo) {
-            auto str_idx = *reinterpret_cast<const dex::u4 *>(&inst[1]);
-            if (str_lower <= str_idx && str_upper > str_idx) {
-                match_str = true;
-            }
-            str_cache[str_idx].emplace_back(method_id);
-        }
-        if ((opcode >= kOpcodeIGetStart && opcode <= kOpcodeIGetEnd) ||
-            (opcode >= kOpcodeSGetStart && opcode <= kOpcodeSGetEnd)) {
-            auto field_idx = inst[1];
-            get_cache[field_idx].emplace_back(method_id);
-        }
-        if ((opcode >= kOpcodeIPutStart && opcode <= kOpcodeIPutEnd) ||
-            (opcode >= kOpcodeSPutStart && opcode <= kOpcodeSPutEnd)) {
-            auto field_idx = inst[1];
-            set_cache[field_idx].emplace_back(method_id);
-        }
-        if ((opcode >= kOpcodeInvokeStart && opcode <= kOpcodeInvokeEnd) ||
-            (opcode >= kOpcodeInvokeRangeStart && opcode <= kOpcodeInvokeRangeEnd)) {
-            auto callee = inst[1];
-            inv_cache[method_id].emplace_back(callee);
-            inved_cache[callee].emplace_back(method_id);
-        }
-        if (opcode == kOpcodeNoOp) {
-            if (*inst == kInstPackedSwitchPlayLoad) {
-                inst += inst[1] * 2 + 3;
-            } else if (*inst == kInstSparseSwitchPlayLoad) {
-                inst += inst[1] * 4 + 1;
-            } else if (*inst == kInstFillArrayDataPlayLoad) {
-                inst += (*reinterpret_cast<const dex::u4 *>(&inst[2]) * inst[1] + 1) / 2 + 3;
-            }
+        const auto &info = kOpcodeInfo[*inst & 0xff];
+        switch (info.kind) {
+            case OpcodeKind::kOther:
+                break;
+            case OpcodeKind::kConstString:
+            case OpcodeKind::kConstStringJumbo:
+                if constexpr ((kRelations & (1u << kUsingString)) != 0) {
+                    uint32_t str_idx = info.kind == OpcodeKind::kConstString
+                                           ? inst[1]
+                                           : *reinterpret_cast<const dex::u4 *>(&inst[1]);
+                    emit(kUsingString, str_idx, method_id);
+                }
+                break;
+            case OpcodeKind::kGetField:
+                if constexpr ((kRelations & (1u << kGetting)) != 0) {
+                    emit(kGetting, inst[1], method_id);
+                }
+                break;
+            case OpcodeKind::kPutField:
+                if constexpr ((kRelations & (1u << kSetting)) != 0) {
+                    emit(kSetting, inst[1], method_id);
+                }
+                break;
+            case OpcodeKind::kInvoke:
+                if constexpr ((kRelations & (1u << kInvoking)) != 0) {
+                    emit(kInvoking, method_id, inst[1]);
+                }
+                if constexpr ((kRelations & (1u << kInvoked)) != 0) {
+                    emit(kInvoked, inst[1], method_id);
+                }
+                break;
+            case OpcodeKind::kUseType:
+                if constexpr ((kRelations & (1u << kUsingType)) != 0) {
+                    emit(kUsingType, inst[1] * kTypeUsageCount + info.type_usage, method_id);
+                }
+                break;
+            case OpcodeKind::kConstNumber:
+                if constexpr ((kRelations & (1u << kUsingNumber)) != 0) {
+                    emit(kUsingNumber, static_cast<uint64_t>(DecodeLiteral(inst)), method_id);
+                }
+                break;
+            case OpcodeKind::kNop:
+                if (*inst == kInstPackedSwitchPlayLoad) {
+                    if constexpr ((kRelations & (1u << kUsingNumber)) != 0) {
+                        // size, then first_key: the keys are first_key .. first_key + size - 1
+                        auto first_key = static_cast<int32_t>(inst[2] | uint32_t(inst[3]) << 16);
+                        for (auto i = 0u; i < inst[1]; ++i) {
+                            auto key = static_cast<int32_t>(static_cast<uint32_t>(first_key) + i);
+                            emit(kUsingNumber, static_cast<uint64_t>(int64_t(key)), method_id);
+                        }
+                    }
+                    inst += inst[1] * 2 + 3;
+                } else if (*inst == kInstSparseSwitchPlayLoad) {
+                    if constexpr ((kRelations & (1u << kUsingNumber)) != 0) {
+                        // size, then the sorted keys
+                        for (auto i = 0u; i < inst[1]; ++i) {
+                            auto key = static_cast<int32_t>(inst[2 + 2 * i] | uint32_t(inst[3 + 2 * i]) << 16);
+                            emit(kUsingNumber, static_cast<uint64_t>(int64_t(key)), method_id);
+                        }
+                    }
+                    inst += inst[1] * 4 + 1;
+                } else if (*inst == kInstFillArrayDataPlayLoad) {
+                    inst += (*reinterpret_cast<const dex::u4 *>(&inst[2]) * inst[1] + 1) / 2 + 3;
+                }
+                break;
         }
-        inst += dex::opcode_len[opcode];
+        inst += info.width;
     }
-    return match_str;
 }
 
 std::tuple<std::vector<std::vector<uint32_t>>, std::vector<std::vector<uint32_t>>>
@@ -286,7 +886,7 @@ DexHelper::ConvertParameters(const std::vector<size_t> &parameter_types,
                 }
                 break;
             }
-            auto &ids = class_indices_[param];
+            const auto ids = class_indices_[param];
             for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
                 parameter_types_ids[dex_idx].emplace_back(ids[dex_idx]);
             }
@@ -301,7 +901,7 @@ DexHelper::ConvertParameters(const std::vector<size_t> &parameter_types,
             if (param != size_t(-1) && param >= class_indices_.size()) {
                 return {parameter_types_ids, contains_parameter_types_ids};
             }
-            auto &ids = class_indices_[param];
+            const auto ids = class_indices_[param];
             for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
                 contains_parameter_types_ids[dex_idx].emplace_back(ids[dex_idx]);
             }
@@ -310,6 +910,48 @@ DexHelper::ConvertParameters(const std::vector<size_t> &parameter_types,
     return {parameter_types_ids, contains_parameter_types_ids};
 }
 
+template <unsigned kFilters>
+bool DexHelper::IsMethodMatch(size_t dex_id, uint32_t method_id, const MethodFilter &filter) const {
+    const auto &columns = method_columns_[dex_id];
+    if constexpr (kFilters & kMatchDeclaringClass) {
+        if (columns.class_ids[method_id] != filter.declaring_class) return false;
+    }
+    if constexpr (kFilters & kMatchReturnType) {
+        if (columns.return_types[method_id] != filter.return_type) return false;
+    }
+    if constexpr (kFilters & kMatchShorty) {
+        if (columns.shorties[method_id] != filter.shorty) return false;
+    }
+    if constexpr (kFilters & kMatchParameters) {
+        const auto &parameter_types = *filter.parameter_types;
+        const auto params_size = columns.parameter_counts[method_id];
+        if (filter.parameter_count != -1 && params_size != filter.parameter_count) return false;
+        if (!parameter_types.empty()) {
+            if (parameter_types.size() != params_size) return false;
+            if (parameter_types[0] != uint32_t(-2) && parameter_types[0] != columns.first_parameters[method_id]) return false;
+        }
+        // only the rest of the parameters need the type list
+        if (parameter_types.size() > 1 || !filter.contains_parameter_types->empty()) {
+            return IsProtoMatch(dex_id, readers_[dex_id].MethodIds()[method_id].proto_idx, filter);
+        }
+    }
+    return true;
+}
+
+template <typename Fn>
+bool DexHelper::WithMethodMatcher(size_t dex_idx, const MethodFilter &filter, Fn &&fn) const {
+    const auto filters = GetMatchFilters(filter);
+    return [&]<unsigned... kFilters>(std::integer_sequence<unsigned, kFilters...>) {
+        bool result = false;
+        ((filters == kFilters &&
+          (result = fn([this, dex_idx, &filter](uint32_t method_id) {
+               return IsMethodMatch<kFilters>(dex_idx, method_id, filter);
+           }), true)) ||
+         ...);
+        return result;
+    }(std::make_integer_sequence<unsigned, kMatchFilterCount>());
+}
+
 std::vector<size_t> DexHelper::FindMethodUsingString(
     std::string_view str, bool match_prefix, size_t return_type, short parameter_count,
     std::string_view parameter_shorty, size_t declaring_class,
@@ -323,6 +965,7 @@ std::vector<size_t> DexHelper::FindMethodUsingString(
         ConvertParameters(parameter_types, contains_parameter_types);
 
     for (auto dex_idx : GetPriority(dex_priority)) {
+        EnsureDex(dex_idx);
         uint32_t lower;
         uint32_t upper;
         if (match_prefix) {
@@ -333,54 +976,298 @@ std::vector<size_t> DexHelper::FindMethodUsingString(
             if (lower == dex::kNoIndex) continue;
             ++upper;
         }
-        const auto &codes = method_codes_[dex_idx];
-        const auto &strs = string_cache_[dex_idx];
-        const auto return_type_id = return_type == size_t(-1) ? uint32_t(-2) : class_indices_[return_type][dex_idx];
-        const auto declaring_class_id = declaring_class == size_t(-1) ? uint32_t(-2): class_indices_[declaring_class][dex_idx];
+        auto lock = LockDex(dex_idx);
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        if (FindMethodUsingStringIds(dex_idx, {{lower, upper}}, filter, find_first, out)) {
+            return out;
+        }
+    }
+    return out;
+}
+
+std::vector<size_t> DexHelper::FindMethodUsingSubstring(
+    std::string_view str, bool regex, size_t return_type, short parameter_count,
+    std::string_view parameter_shorty, size_t declaring_class,
+    const std::vector<size_t> &parameter_types, const std::vector<size_t> &contains_parameter_types,
+    const std::vector<size_t> &dex_priority, bool find_first) const {
+    std::vector<size_t> out;
+
+    if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
+    if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
+    const auto [parameter_types_ids, contains_parameter_types_ids] =
+        ConvertParameters(parameter_types, contains_parameter_types);
+
+    for (auto dex_idx : GetPriority(dex_priority)) {
+        EnsureDex(dex_idx);
+        IdRanges strings;
+        if (!FindMatchingStringIds(dex_idx, str, regex, strings)) return out;
+        if (strings.empty()) continue;
+        auto lock = LockDex(dex_idx);
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        if (FindMethodUsingStringIds(dex_idx, strings, filter, find_first, out)) {
+            return out;
+        }
+    }
+    return out;
+}
+
+std::vector<size_t> DexHelper::FindMethodUsingSimilarString(
+    std::string_view str, size_t max_distance, size_t return_type, short parameter_count,
+    std::string_view parameter_shorty, size_t declaring_class,
+    const std::vector<size_t> &parameter_types, const std::vector<size_t> &contains_parameter_types,
+    const std::vector<size_t> &dex_priority, bool find_first) const {
+    std::vector<size_t> out;
+
+    if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
+    if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
+    const auto [parameter_types_ids, contains_parameter_types_ids] =
+        ConvertParameters(parameter_types, contains_parameter_types);
+
+    const auto priority = GetPriority(dex_priority);
+    // strings[dex_idx][d] -> the str_ids at distance d, every dex is searched before any
+    // method is looked up so that nearer strings come first across dexs
+    std::vector<std::vector<IdRanges>> strings(readers_.size());
+    auto farthest = 0zu;
+    for (auto dex_idx : priority) {
+        EnsureDex(dex_idx);
+        FindSimilarStringIds(dex_idx, str, max_distance, strings[dex_idx]);
+        farthest = std::max(farthest, strings[dex_idx].size());
+    }
+    max_distance = std::min(max_distance, farthest);
 
+    // a method using strings at several distances is only listed at the nearest
+    phmap::flat_hash_set<size_t> found;
+    for (auto distance = 0zu; distance <= max_distance; ++distance) {
+        for (auto dex_idx : priority) {
+            if (distance >= strings[dex_idx].size() || strings[dex_idx][distance].empty()) continue;
+            const auto &ids = strings[dex_idx][distance];
+            auto lock = LockDex(dex_idx);
+            const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count,
+                                                parameter_shorty, declaring_class,
+                                                parameter_types_ids[dex_idx],
+                                                contains_parameter_types_ids[dex_idx]);
+            const auto begin = out.size();
+            const auto first = FindMethodUsingStringIds(dex_idx, ids, filter, find_first, out);
+            out.erase(std::remove_if(out.begin() + begin, out.end(),
+                                     [&](size_t method) { return !found.insert(method).second; }),
+                      out.end());
+            if (first) return out;
+        }
+    }
+    return out;
+}
+
+bool DexHelper::FindMethodUsingStringIds(size_t dex_idx, const IdRanges &strings,
+                                         const MethodFilter &filter, bool find_first,
+                                         std::vector<size_t> &out) const {
+    const auto &strs = string_cache_[dex_idx];
+    return WithMethodMatcher(dex_idx, filter, [&](auto is_match) {
         if (find_first) {
+            for (const auto &[lower, upper] : strings) {
+                for (auto s = lower; s < upper; ++s) {
+                    for (const auto &m : strs[s]) {
+                        if (is_match(m)) {
+                            out.emplace_back(CreateMethodIndex(dex_idx, m));
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+
+        // a fully scanned dex has all its answers cached already
+        const auto plan = fully_scanned_[dex_idx].load(std::memory_order_acquire)
+                              ? MethodPlan{}
+                              : PlanMethodScan(dex_idx, filter);
+        auto &scanned = searched_methods_[dex_idx];
+        for (auto i = plan.first; i < plan.last; ++i) {
+            const auto method_id = plan[i];
+            if (scanned[method_id]) continue;
+            if (!is_match(method_id)) continue;
+            if (no_cache_) {
+                // the cached lists below only hold methods scanned before. they list a method
+                // once per use, and so does this
+                auto count = CountRelation<kUsingString>(dex_idx, method_id, strings);
+                if (count && find_first) {
+                    out.emplace_back(CreateMethodIndex(dex_idx, method_id));
+                    return true;
+                }
+                out.insert(out.end(), count, CreateMethodIndex(dex_idx, method_id));
+            } else {
+                bool match = ScanMethod(dex_idx, method_id, strings);
+                if (match && find_first) break;
+            }
+        }
+
+        for (const auto &[lower, upper] : strings) {
             for (auto s = lower; s < upper; ++s) {
                 for (const auto &m : strs[s]) {
-                    if (IsMethodMatch(dex_idx, m,
-                                      return_type_id,
-                                      parameter_count, parameter_shorty,
-                                      declaring_class_id,
-                                      parameter_types_ids[dex_idx],
-                                      contains_parameter_types_ids[dex_idx])) {
+                    if (is_match(m)) {
                         out.emplace_back(CreateMethodIndex(dex_idx, m));
-                        return out;
+                        if (find_first) return true;
                     }
                 }
             }
         }
+        return false;
+    });
+}
 
-        for (auto method_id = 0zu; method_id < codes.size(); ++method_id) {
-            auto &scanned = searched_methods_[dex_idx];
+std::vector<std::vector<size_t>> DexHelper::FindMethodUsingStrings(
+    const std::vector<StringQuery> &queries, const std::vector<size_t> &dex_priority) const {
+    std::vector<std::vector<size_t>> out(queries.size());
+
+    // the shared pass gathers its answers in the caches, without them each query reads on its own
+    if (no_cache_) {
+        for (auto i = 0zu; i < queries.size(); ++i) {
+            const auto &query = queries[i];
+            out[i] = FindMethodUsingString(query.str, query.match_prefix, query.return_type,
+                                           query.parameter_count, query.parameter_shorty,
+                                           query.declaring_class, query.parameter_types,
+                                           query.contains_parameter_types, dex_priority,
+                                           query.find_first);
+        }
+        return out;
+    }
+
+    struct Pending {
+        const StringQuery *query;
+        std::vector<size_t> *out;
+        std::vector<std::vector<uint32_t>> parameter_types_ids;
+        std::vector<std::vector<uint32_t>> contains_parameter_types_ids;
+        // for the dex being searched
+        uint32_t lower = dex::kNoIndex;
+        uint32_t upper = dex::kNoIndex;
+        MethodFilter filter{};
+        // the queries differ in their filters, so each is matched through its own specialization
+        MethodMatcher matcher = nullptr;
+        // the method ids it can match
+        MethodPlan plan{};
+        bool hit = false;
+    };
+    std::vector<Pending> pending;
+    pending.reserve(queries.size());
+    for (auto i = 0zu; i < queries.size(); ++i) {
+        const auto &query = queries[i];
+        if (query.return_type != size_t(-1) && query.return_type >= class_indices_.size()) continue;
+        if (query.declaring_class != size_t(-1) && query.declaring_class >= class_indices_.size()) continue;
+        auto [parameter_types_ids, contains_parameter_types_ids] =
+            ConvertParameters(query.parameter_types, query.contains_parameter_types);
+        pending.push_back({.query = &query,
+                           .out = &out[i],
+                           .parameter_types_ids = std::move(parameter_types_ids),
+                           .contains_parameter_types_ids = std::move(contains_parameter_types_ids)});
+    }
+
+    for (auto dex_idx : GetPriority(dex_priority)) {
+        if (pending.empty()) break;
+        EnsureDex(dex_idx);
+        // the queries with strings in this dex
+        std::vector<Pending *> active;
+        for (auto &p : pending) {
+            const auto &query = *p.query;
+            if (query.match_prefix) {
+                std::tie(p.lower, p.upper) = FindPrefixStringId(dex_idx, query.str);
+                if (p.lower == dex::kNoIndex) continue;
+            } else {
+                p.lower = p.upper = FindPrefixStringIdExact(dex_idx, query.str);
+                if (p.lower == dex::kNoIndex) continue;
+                ++p.upper;
+            }
+            p.filter = GetMethodFilter(dex_idx, query.return_type, query.parameter_count,
+                                       query.parameter_shorty, query.declaring_class,
+                                       p.parameter_types_ids[dex_idx], p.contains_parameter_types_ids[dex_idx]);
+            p.matcher = GetMethodMatcher(p.filter);
+            p.plan = PlanMethodScan(dex_idx, p.filter);
+            p.hit = false;
+            active.emplace_back(&p);
+        }
+        if (active.empty()) continue;
+
+        auto lock = LockDex(dex_idx);
+        const auto &strs = string_cache_[dex_idx];
+        auto is_match = [this, dex_idx](const Pending &p, uint32_t method_id) {
+            return (this->*p.matcher)(dex_idx, method_id, p.filter);
+        };
+        auto find_cached = [&](const Pending &p) {
+            for (auto s = p.lower; s < p.upper; ++s) {
+                for (const auto &m : strs[s]) {
+                    if (is_match(p, m)) return true;
+                }
+            }
+            return false;
+        };
+
+        std::vector<Pending *> scanning;
+        // the pass covers every method some query can match: the merged lists if all of them
+        // listed their methods, else the run of method ids spanning all plans
+        MethodPlan plan;
+        bool listed = true;
+        uint32_t first = std::numeric_limits<uint32_t>::max();
+        uint32_t last = 0;
+        for (auto *p : active) {
+            if (p->plan.first == p->plan.last) continue;
+            if (p->query->find_first && find_cached(*p)) continue;
+            scanning.emplace_back(p);
+            const auto &methods = p->plan.methods;
+            listed = listed && !methods.empty();
+            first = std::min(first, methods.empty() ? p->plan.first : methods.front());
+            last = std::max(last, methods.empty() ? p->plan.last : methods.back() + 1);
+        }
+        if (listed) {
+            for (auto *p : scanning) {
+                plan.methods.insert(plan.methods.end(), p->plan.methods.begin(), p->plan.methods.end());
+            }
+            std::sort(plan.methods.begin(), plan.methods.end());
+            plan.methods.erase(std::unique(plan.methods.begin(), plan.methods.end()), plan.methods.end());
+            plan.last = plan.methods.size();
+        } else {
+            plan.first = first;
+            plan.last = last;
+        }
+        auto &scanned = searched_methods_[dex_idx];
+        auto caches = GetScanCaches(dex_idx);
+        for (auto i = plan.first; i < plan.last && !scanning.empty(); ++i) {
+            const auto method_id = plan[i];
             if (scanned[method_id]) continue;
-            if (IsMethodMatch(
-                    dex_idx, method_id,
-                    return_type_id,
-                    parameter_count, parameter_shorty,
-                    declaring_class_id,
-                    parameter_types_ids[dex_idx], contains_parameter_types_ids[dex_idx])) {
-                bool match = ScanMethod(dex_idx, method_id, lower, upper);
-                if (match && find_first) break;
+            if (std::none_of(scanning.begin(), scanning.end(),
+                             [&](const Pending *p) { return is_match(*p, method_id); })) {
+                continue;
+            }
+            scanned[method_id] = true;
+            bool answered = false;
+            ScanCode(dex_idx, method_id,
+                     [&](ScanRelation relation, uint64_t key, uint32_t value) {
+                         caches.emplace_back(relation, key, value);
+                         if (relation != kUsingString) return;
+                         // only a find_first query needs to know, the others wait for the full pass
+                         for (auto *p : scanning) {
+                             if (p->query->find_first && !p->hit && p->lower <= key && p->upper > key &&
+                                 is_match(*p, method_id)) {
+                                 p->hit = answered = true;
+                             }
+                         }
+                     });
+            if (answered) {
+                std::erase_if(scanning, [](const Pending *p) { return p->hit; });
             }
         }
 
-        for (auto s = lower; s < upper; ++s) {
-            for (const auto &m : strs[s]) {
-                if (IsMethodMatch(dex_idx, m,
-                        return_type_id,
-                                 parameter_count, parameter_shorty,
-                                 declaring_class_id,
-                                 parameter_types_ids[dex_idx],
-                                 contains_parameter_types_ids[dex_idx])) {
-                    out.emplace_back(CreateMethodIndex(dex_idx, m));
-                    if (find_first) return out;
+        for (auto *p : active) {
+            for (auto s = p->lower; s < p->upper; ++s) {
+                for (const auto &m : strs[s]) {
+                    if (!is_match(*p, m)) continue;
+                    p->out->emplace_back(CreateMethodIndex(dex_idx, m));
+                    if (p->query->find_first) break;
                 }
+                if (p->query->find_first && !p->out->empty()) break;
             }
         }
+        std::erase_if(pending, [](const Pending &p) { return p.query->find_first && !p.out->empty(); });
     }
     return out;
 }
@@ -403,88 +1290,292 @@ std::vector<size_t> DexHelper::FindMethodInvoking(
     for (auto dex_idx : GetPriority(dex_priority)) {
         auto caller_id = method_ids[dex_idx];
         if (caller_id == dex::kNoIndex) continue;
-        const auto return_type_id = return_type == size_t(-1) ? uint32_t(-2) : class_indices_[return_type][dex_idx];
-        const auto declaring_class_id = declaring_class == size_t(-1) ? uint32_t(-2): class_indices_[declaring_class][dex_idx];
-        ScanMethod(dex_idx, caller_id);
-        for (auto callee : invoking_cache_[dex_idx][caller_id]) {
-            if (IsMethodMatch(
-                    dex_idx, callee,
-                    return_type_id,
-                    parameter_count, parameter_shorty,
-                    declaring_class_id,
-                    parameter_types_ids[dex_idx], contains_parameter_types_ids[dex_idx])) {
+        EnsureDex(dex_idx);
+        auto lock = LockDex(dex_idx);
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        // without caching the callees are read from the code of the caller directly
+        std::vector<uint32_t> uncached;
+        if (no_cache_ && !searched_methods_[dex_idx][caller_id]) {
+            ScanCode<1u << kInvoking>(dex_idx, caller_id,
+                                      [&uncached](ScanRelation, uint64_t, uint32_t callee) {
+                                          uncached.emplace_back(callee);
+                                      });
+        } else {
+            ScanMethod(dex_idx, caller_id);
+        }
+        const auto callees = uncached.empty() ? invoking_cache_[dex_idx][caller_id]
+                                              : std::span<const uint32_t>(uncached);
+        bool found = WithMethodMatcher(dex_idx, filter, [&](auto is_match) {
+            for (auto callee : callees) {
+                if (is_match(callee)) {
+                    out.emplace_back(CreateMethodIndex(dex_idx, callee));
+                    if (find_first) return true;
+                }
+            }
+            return false;
+        });
+        if (found) return out;
+    }
+    return out;
+}
+
+std::vector<size_t> DexHelper::FindMethodInvoked(
+    size_t method_idx, size_t return_type, short parameter_count, std::string_view parameter_shorty,
+    size_t declaring_class, const std::vector<size_t> &parameter_types,
+    const std::vector<size_t> &contains_parameter_types, const std::vector<size_t> &dex_priority,
+    bool find_first) const {
+    std::vector<size_t> out;
+
+    if (method_idx >= method_indices_.size()) return out;
+    if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
+    if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
+    const auto [parameter_types_ids, contains_parameter_types_ids] =
+        ConvertParameters(parameter_types, contains_parameter_types);
+
+    const auto method_ids = method_indices_[method_idx];
+
+    for (auto dex_idx : GetPriority(dex_priority)) {
+        auto callee_id = method_ids[dex_idx];
+        if (callee_id == dex::kNoIndex) continue;
+        EnsureDex(dex_idx);
+        auto lock = LockDex(dex_idx);
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        if (FindRelatedMethods<kInvoked>(dex_idx, {{callee_id, callee_id + 1}}, filter,
+                                         find_first, out)) {
+            return out;
+        }
+    }
+    return out;
+}
+
+std::vector<size_t> DexHelper::FindMethodInvokedByDispatch(
+    size_t method_idx, size_t return_type, short parameter_count, std::string_view parameter_shorty,
+    size_t declaring_class, const std::vector<size_t> &parameter_types,
+    const std::vector<size_t> &contains_parameter_types, const std::vector<size_t> &dex_priority,
+    bool find_first) const {
+    std::vector<size_t> out;
+
+    if (method_idx >= method_indices_.size()) return out;
+    if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
+    if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
+    const auto [parameter_types_ids, contains_parameter_types_ids] =
+        ConvertParameters(parameter_types, contains_parameter_types);
+
+    const auto callees = FindDispatchingMethodIds(method_idx);
+    // a method calling several of the callees is listed once
+    phmap::flat_hash_set<size_t> found;
+    for (auto dex_idx : GetPriority(dex_priority)) {
+        if (callees[dex_idx].empty()) continue;
+        EnsureDex(dex_idx);
+        auto lock = LockDex(dex_idx);
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        const auto begin = out.size();
+        const auto first = FindRelatedMethods<kInvoked>(dex_idx, callees[dex_idx], filter,
+                                                        find_first, out);
+        out.erase(std::remove_if(out.begin() + begin, out.end(),
+                                 [&](size_t method) { return !found.insert(method).second; }),
+                  out.end());
+        if (first) return out;
+    }
+    return out;
+}
+
+std::vector<size_t> DexHelper::FindReachableMethods(
+    size_t method_idx, size_t max_depth, size_t return_type, short parameter_count,
+    std::string_view parameter_shorty, size_t declaring_class,
+    const std::vector<size_t> &parameter_types, const std::vector<size_t> &contains_parameter_types,
+    const std::vector<size_t> &dex_priority, bool find_first, size_t threads) const {
+    return FindMethodsTransitive<kInvoking>(method_idx, max_depth, return_type, parameter_count,
+                                            parameter_shorty, declaring_class, parameter_types,
+                                            contains_parameter_types, dex_priority, find_first,
+                                            threads);
+}
+
+std::vector<size_t> DexHelper::FindCallersTransitive(
+    size_t method_idx, size_t max_depth, size_t return_type, short parameter_count,
+    std::string_view parameter_shorty, size_t declaring_class,
+    const std::vector<size_t> &parameter_types, const std::vector<size_t> &contains_parameter_types,
+    const std::vector<size_t> &dex_priority, bool find_first, size_t threads) const {
+    return FindMethodsTransitive<kInvoked>(method_idx, max_depth, return_type, parameter_count,
+                                           parameter_shorty, declaring_class, parameter_types,
+                                           contains_parameter_types, dex_priority, find_first,
+                                           threads);
+}
+
+void DexHelper::FindCallees(size_t method_idx, const std::vector<size_t> &dex_priority,
+                            std::vector<size_t> &out) const {
+    const auto method_ids = method_indices_[method_idx];
+    for (auto dex_idx : dex_priority) {
+        auto method_id = method_ids[dex_idx];
+        if (method_id == dex::kNoIndex) continue;
+        auto lock = LockDex(dex_idx);
+        if (no_cache_ && !searched_methods_[dex_idx][method_id]) {
+            ScanCode<1u << kInvoking>(dex_idx, method_id,
+                                      [&](ScanRelation, uint64_t, uint32_t callee) {
+                                          out.emplace_back(CreateMethodIndex(dex_idx, callee));
+                                      });
+        } else {
+            ScanMethod(dex_idx, method_id);
+            for (auto callee : invoking_cache_[dex_idx][method_id]) {
                 out.emplace_back(CreateMethodIndex(dex_idx, callee));
-                if (find_first) return out;
             }
         }
     }
+}
+
+void DexHelper::FindCallers(const std::vector<size_t> &methods,
+                            const std::vector<size_t> &dex_priority, size_t threads,
+                            std::vector<std::vector<size_t>> &out) const {
+    const std::vector<uint32_t> any_parameters;
+    const MethodFilter any{.parameter_types = &any_parameters,
+                           .contains_parameter_types = &any_parameters};
+    // found[k] -> (position in methods, caller) in dex_priority[k]
+    std::vector<std::vector<std::pair<size_t, size_t>>> found(dex_priority.size());
+    RunTasks(dex_priority.size(), threads, [&](size_t k) {
+        const auto dex_idx = dex_priority[k];
+        // (method_id, position) of the methods the dex has, by method_id
+        std::vector<std::pair<uint32_t, size_t>> ids;
+        for (auto i = 0zu; i < methods.size(); ++i) {
+            if (auto method_id = method_indices_[methods[i]][dex_idx]; method_id != dex::kNoIndex) {
+                ids.emplace_back(method_id, i);
+            }
+        }
+        if (ids.empty()) return;
+        std::sort(ids.begin(), ids.end());
+        IdRanges keys;
+        for (auto [method_id, i] : ids) {
+            if (!keys.empty() && keys.back().second >= method_id) {
+                keys.back().second = std::max(keys.back().second, method_id + 1);
+            } else {
+                keys.emplace_back(method_id, method_id + 1);
+            }
+        }
+        std::vector<size_t> callers;
+        std::vector<uint32_t> callees;
+        {
+            auto lock = LockDex(dex_idx);
+            FindRelatedMethods<kInvoked>(dex_idx, keys, any, false, callers, &callees);
+        }
+        for (auto j = 0zu; j < callers.size(); ++j) {
+            auto callee = std::lower_bound(ids.begin(), ids.end(), std::pair(callees[j], 0zu));
+            found[k].emplace_back(callee->second, callers[j]);
+        }
+    });
+    // each method gets its callers in dex_priority order, as searching it alone would
+    for (const auto &dex_found : found) {
+        for (auto [i, caller] : dex_found) out[i].emplace_back(caller);
+    }
+}
+
+template <DexHelper::ScanRelation kRelation>
+std::vector<size_t> DexHelper::FindMethodsTransitive(
+    size_t method_idx, size_t max_depth, size_t return_type, short parameter_count,
+    std::string_view parameter_shorty, size_t declaring_class,
+    const std::vector<size_t> &parameter_types, const std::vector<size_t> &contains_parameter_types,
+    const std::vector<size_t> &dex_priority, bool find_first, size_t threads) const {
+    // levels narrower than this are not worth starting workers for
+    constexpr auto kParallelLevel = 64zu;
+    std::vector<size_t> out;
+
+    if (method_idx >= method_indices_.size()) return out;
+    if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
+    if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
+    const auto [parameter_types_ids, contains_parameter_types_ids] =
+        ConvertParameters(parameter_types, contains_parameter_types);
+
+    const auto dexs = GetPriority(dex_priority);
+    std::vector<MethodFilter> filters(readers_.size());
+    std::vector<MethodMatcher> matchers(readers_.size());
+    for (auto dex_idx : dexs) {
+        EnsureDex(dex_idx);
+        filters[dex_idx] = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                           declaring_class, parameter_types_ids[dex_idx],
+                                           contains_parameter_types_ids[dex_idx]);
+        matchers[dex_idx] = GetMethodMatcher(filters[dex_idx]);
+    }
+    // a method is the same in every dex that has it, so the first one decides
+    auto is_match = [&](size_t index) {
+        const auto method_ids = method_indices_[index];
+        for (auto dex_idx : dexs) {
+            if (method_ids[dex_idx] == dex::kNoIndex) continue;
+            return (this->*matchers[dex_idx])(dex_idx, method_ids[dex_idx], filters[dex_idx]);
+        }
+        return false;
+    };
+
+    // methods met are resolved to indices on demand, which may add indices, so visited grows
+    // with them
+    std::vector<bool> visited(method_indices_.size());
+    visited[method_idx] = true;
+    std::vector<size_t> frontier{method_idx};
+    for (auto depth = 0zu; depth < max_depth && !frontier.empty(); ++depth) {
+        // neighbors[i] -> the methods one call away from frontier[i]. callers are found for the
+        // whole level at once, callees of a narrow level one method at a time, so find_first
+        // stops as soon as it can
+        std::vector<std::vector<size_t>> neighbors(frontier.size());
+        const bool parallel = threads > 1 && frontier.size() >= kParallelLevel;
+        if constexpr (kRelation == kInvoked) {
+            FindCallers(frontier, dexs, parallel ? threads : 1, neighbors);
+        } else if (parallel) {
+            RunTasks(frontier.size(), threads,
+                     [&](size_t i) { FindCallees(frontier[i], dexs, neighbors[i]); });
+        }
+        std::vector<size_t> next;
+        for (auto i = 0zu; i < frontier.size(); ++i) {
+            if (kRelation == kInvoking && !parallel) FindCallees(frontier[i], dexs, neighbors[i]);
+            for (auto index : neighbors[i]) {
+                if (index >= visited.size()) visited.resize(method_indices_.size());
+                if (visited[index]) continue;
+                visited[index] = true;
+                next.emplace_back(index);
+                if (is_match(index)) {
+                    out.emplace_back(index);
+                    if (find_first) return out;
+                }
+            }
+            std::vector<size_t>().swap(neighbors[i]);
+        }
+        frontier = std::move(next);
+    }
     return out;
 }
 
-std::vector<size_t> DexHelper::FindMethodInvoked(
-    size_t method_idx, size_t return_type, short parameter_count, std::string_view parameter_shorty,
+std::vector<size_t> DexHelper::FindMethodGettingField(
+    size_t field_idx, size_t return_type, short parameter_count, std::string_view parameter_shorty,
     size_t declaring_class, const std::vector<size_t> &parameter_types,
     const std::vector<size_t> &contains_parameter_types, const std::vector<size_t> &dex_priority,
     bool find_first) const {
     std::vector<size_t> out;
 
-    if (method_idx >= method_indices_.size()) return out;
+    if (field_idx >= field_indices_.size()) return out;
     if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
     if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
     const auto [parameter_types_ids, contains_parameter_types_ids] =
         ConvertParameters(parameter_types, contains_parameter_types);
-
-    const auto method_ids = method_indices_[method_idx];
-
+    const auto field_ids = field_indices_[field_idx];
     for (auto dex_idx : GetPriority(dex_priority)) {
-        auto callee_id = method_ids[dex_idx];
-        if (callee_id == dex::kNoIndex) continue;
-        const auto &codes = method_codes_[dex_idx];
-        const auto &cache = invoked_cache_[dex_idx][callee_id];
-        const auto return_type_id = return_type == size_t(-1) ? uint32_t(-2) : class_indices_[return_type][dex_idx];
-        const auto declaring_class_id = declaring_class == size_t(-1) ? uint32_t(-2): class_indices_[declaring_class][dex_idx];
-        if (find_first && !cache.empty()) {
-            for(const auto &caller : cache) {
-                if (IsMethodMatch(dex_idx, caller,
-                                  return_type_id,
-                                  parameter_count, parameter_shorty,
-                                  declaring_class_id,
-                                  parameter_types_ids[dex_idx],
-                                  contains_parameter_types_ids[dex_idx])) {
-                    out.emplace_back(CreateMethodIndex(dex_idx, caller));
-                    return out;
-                }
-            }
-        }
-        for (auto method_id = 0zu; method_id < codes.size(); ++method_id) {
-            auto &scanned = searched_methods_[dex_idx];
-            if (scanned[method_id]) continue;
-            if (IsMethodMatch(
-                    dex_idx, method_id,
-                    return_type_id,
-                    parameter_count, parameter_shorty,
-                    declaring_class_id,
-                    parameter_types_ids[dex_idx], contains_parameter_types_ids[dex_idx])) {
-                ScanMethod(dex_idx, method_id);
-                if (find_first && !cache.empty()) break;
-            }
-        }
-        for (const auto &caller : cache) {
-            if (IsMethodMatch(dex_idx, caller,
-                              return_type_id,
-                              parameter_count, parameter_shorty,
-                              declaring_class_id,
-                              parameter_types_ids[dex_idx],
-                              contains_parameter_types_ids[dex_idx])) {
-                out.emplace_back(CreateMethodIndex(dex_idx, caller));
-                if (find_first) return out;
-            }
+        auto field_id = field_ids[dex_idx];
+        if (field_id == dex::kNoIndex) continue;
+        EnsureDex(dex_idx);
+        auto lock = LockDex(dex_idx);
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        if (FindRelatedMethods<kGetting>(dex_idx, {{field_id, field_id + 1}}, filter,
+                                         find_first, out)) {
+            return out;
         }
     }
     return out;
 }
 
-std::vector<size_t> DexHelper::FindMethodGettingField(
+std::vector<size_t> DexHelper::FindMethodSettingField(
     size_t field_idx, size_t return_type, short parameter_count, std::string_view parameter_shorty,
     size_t declaring_class, const std::vector<size_t> &parameter_types,
     const std::vector<size_t> &contains_parameter_types, const std::vector<size_t> &dex_priority,
@@ -496,126 +1587,283 @@ std::vector<size_t> DexHelper::FindMethodGettingField(
     if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
     const auto [parameter_types_ids, contains_parameter_types_ids] =
         ConvertParameters(parameter_types, contains_parameter_types);
-    auto field_ids = field_indices_[field_idx];
+    const auto field_ids = field_indices_[field_idx];
     for (auto dex_idx : GetPriority(dex_priority)) {
         auto field_id = field_ids[dex_idx];
         if (field_id == dex::kNoIndex) continue;
-        const auto &codes = method_codes_[dex_idx];
-        const auto &cache = getting_cache_[dex_idx][field_id];
-        const auto return_type_id = return_type == size_t(-1) ? uint32_t(-2) : class_indices_[return_type][dex_idx];
-        const auto declaring_class_id = declaring_class == size_t(-1) ? uint32_t(-2): class_indices_[declaring_class][dex_idx];
-        if (find_first && !cache.empty()) {
-            for (const auto &getter : cache) {
-                if (IsMethodMatch(dex_idx, getter,
-                                  return_type_id,
-                                  parameter_count, parameter_shorty,
-                                  declaring_class_id,
-                                  parameter_types_ids[dex_idx],
-                                  contains_parameter_types_ids[dex_idx])) {
-                    out.emplace_back(CreateMethodIndex(dex_idx, getter));
-                    return out;
-                }
-            }
-        }
-        for (auto method_id = 0zu; method_id < codes.size(); ++method_id) {
-            auto &scanned = searched_methods_[dex_idx];
-            if (scanned[method_id]) continue;
-            if (IsMethodMatch(
-                    dex_idx, method_id,
-                    return_type_id,
-                    parameter_count, parameter_shorty,
-                    declaring_class_id,
-                    parameter_types_ids[dex_idx], contains_parameter_types_ids[dex_idx])) {
-                ScanMethod(dex_idx, method_id);
-                if (find_first && !cache.empty()) break;
-            }
+        EnsureDex(dex_idx);
+        auto lock = LockDex(dex_idx);
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        if (FindRelatedMethods<kSetting>(dex_idx, {{field_id, field_id + 1}}, filter,
+                                         find_first, out)) {
+            return out;
         }
-        for (const auto &getter : cache) {
-            if (IsMethodMatch(dex_idx, getter,
-                              return_type_id,
-                              parameter_count, parameter_shorty,
-                              declaring_class_id,
-                              parameter_types_ids[dex_idx],
-                              contains_parameter_types_ids[dex_idx])) {
-                out.emplace_back(CreateMethodIndex(dex_idx, getter));
-                if (find_first) return out;
+    }
+    return out;
+}
+
+std::vector<size_t> DexHelper::FindMethodUsingType(
+    size_t class_idx, unsigned kinds, size_t return_type, short parameter_count,
+    std::string_view parameter_shorty, size_t declaring_class,
+    const std::vector<size_t> &parameter_types, const std::vector<size_t> &contains_parameter_types,
+    const std::vector<size_t> &dex_priority, bool find_first) const {
+    std::vector<size_t> out;
+
+    if (class_idx >= class_indices_.size()) return out;
+    if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
+    if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
+    const auto [parameter_types_ids, contains_parameter_types_ids] =
+        ConvertParameters(parameter_types, contains_parameter_types);
+    const auto type_ids = class_indices_[class_idx];
+    for (auto dex_idx : GetPriority(dex_priority)) {
+        auto type_id = type_ids[dex_idx];
+        if (type_id == dex::kNoIndex) continue;
+        EnsureDex(dex_idx);
+        auto lock = LockDex(dex_idx);
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        for (auto usage = 0u; usage < kTypeUsageCount; ++usage) {
+            if (!(kinds & (1u << usage))) continue;
+            const auto key = type_id * kTypeUsageCount + usage;
+            if (FindRelatedMethods<kUsingType>(dex_idx, {{key, key + 1}}, filter, find_first,
+                                               out)) {
+                return out;
             }
         }
     }
     return out;
 }
 
-std::vector<size_t> DexHelper::FindMethodSettingField(
-    size_t field_idx, size_t return_type, short parameter_count, std::string_view parameter_shorty,
+std::vector<size_t> DexHelper::FindMethodUsingNumber(
+    int64_t value, size_t return_type, short parameter_count, std::string_view parameter_shorty,
     size_t declaring_class, const std::vector<size_t> &parameter_types,
     const std::vector<size_t> &contains_parameter_types, const std::vector<size_t> &dex_priority,
     bool find_first) const {
+    return FindMethodUsingNumberRange(value, value, return_type, parameter_count, parameter_shorty,
+                                      declaring_class, parameter_types, contains_parameter_types,
+                                      dex_priority, find_first);
+}
+
+std::vector<size_t> DexHelper::FindMethodUsingNumberRange(
+    int64_t lower, int64_t upper, size_t return_type, short parameter_count,
+    std::string_view parameter_shorty, size_t declaring_class,
+    const std::vector<size_t> &parameter_types, const std::vector<size_t> &contains_parameter_types,
+    const std::vector<size_t> &dex_priority, bool find_first) const {
     std::vector<size_t> out;
 
-    if (field_idx >= field_indices_.size()) return out;
+    if (lower > upper) return out;
     if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
     if (declaring_class != size_t(-1) && declaring_class >= class_indices_.size()) return out;
     const auto [parameter_types_ids, contains_parameter_types_ids] =
         ConvertParameters(parameter_types, contains_parameter_types);
-    auto field_ids = field_indices_[field_idx];
+
     for (auto dex_idx : GetPriority(dex_priority)) {
-        auto field_id = field_ids[dex_idx];
-        if (field_id == dex::kNoIndex) continue;
-        const auto &codes = method_codes_[dex_idx];
-        const auto &cache = setting_cache_[dex_idx][field_id];
-        const auto return_type_id = return_type == size_t(-1) ? uint32_t(-2) : class_indices_[return_type][dex_idx];
-        const auto declaring_class_id = declaring_class == size_t(-1) ? uint32_t(-2): class_indices_[declaring_class][dex_idx];
-        if (find_first && !cache.empty()) {
-            for (const auto &setter : cache) {
-                if (IsMethodMatch(dex_idx, setter,
-                                  return_type_id,
-                                  parameter_count, parameter_shorty,
-                                  declaring_class_id,
-                                  parameter_types_ids[dex_idx],
-                                  contains_parameter_types_ids[dex_idx])) {
-                    out.emplace_back(CreateMethodIndex(dex_idx, setter));
-                    return out;
+        EnsureDex(dex_idx);
+        auto lock = LockDex(dex_idx);
+        const auto &numbers = number_cache_[dex_idx];
+        const auto filter = GetMethodFilter(dex_idx, return_type, parameter_count, parameter_shorty,
+                                            declaring_class, parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+
+        bool found = WithMethodMatcher(dex_idx, filter, [&](auto is_match) {
+            // appends the cached matches among entries [first, last)
+            auto find_cached = [&](size_t first, size_t last) {
+                bool sorted = true;
+                if (first == 0 && last == numbers.size()) {
+                    std::tie(first, last) = numbers.Find(lower, upper, &sorted);
+                } else {
+                    sorted = false;
+                }
+                for (auto i = first; i < last; ++i) {
+                    if (!sorted && (numbers.value(i) < lower || numbers.value(i) > upper)) continue;
+                    if (is_match(numbers.method_id(i))) {
+                        out.emplace_back(CreateMethodIndex(dex_idx, numbers.method_id(i)));
+                        if (find_first) return true;
+                    }
+                }
+                return false;
+            };
+            if (find_first && find_cached(0, numbers.size())) return true;
+
+            // a fully scanned dex has all its answers cached already
+            const auto plan = fully_scanned_[dex_idx].load(std::memory_order_acquire)
+                                  ? MethodPlan{}
+                                  : PlanMethodScan(dex_idx, filter);
+            auto &scanned = searched_methods_[dex_idx];
+            for (auto i = plan.first; i < plan.last; ++i) {
+                const auto method_id = plan[i];
+                if (scanned[method_id]) continue;
+                if (!is_match(method_id)) continue;
+                if (no_cache_) {
+                    // the cached entries below only hold methods scanned before, once per use
+                    auto count = CountNumbers(dex_idx, method_id, lower, upper);
+                    if (count && find_first) {
+                        out.emplace_back(CreateMethodIndex(dex_idx, method_id));
+                        return true;
+                    }
+                    out.insert(out.end(), count, CreateMethodIndex(dex_idx, method_id));
+                } else {
+                    // only the entries this scan appended can answer find_first
+                    auto first = numbers.size();
+                    ScanMethod(dex_idx, method_id);
+                    if (find_first && find_cached(first, numbers.size())) return true;
                 }
             }
+            if (find_first) return false;
+            return find_cached(0, numbers.size());
+        });
+        if (found) return out;
+    }
+    return out;
+}
+
+size_t DexHelper::CountNumbers(size_t dex_idx, uint32_t method_id, int64_t lower,
+                               int64_t upper) const {
+    auto count = 0zu;
+    ScanCode<1u << kUsingNumber>(dex_idx, method_id,
+                                 [&](ScanRelation, uint64_t key, uint32_t) {
+                                     auto value = static_cast<int64_t>(key);
+                                     count += lower <= value && upper >= value;
+                                 });
+    return count;
+}
+
+bool DexHelper::InRanges(const IdRanges &ranges, uint32_t id) {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), id,
+                               [](uint32_t id, const auto &range) { return id < range.first; });
+    return it != ranges.begin() && id < std::prev(it)->second;
+}
+
+template <DexHelper::ScanRelation kRelation>
+size_t DexHelper::CountRelation(size_t dex_idx, uint32_t method_id, const IdRanges &keys) const {
+    auto count = 0zu;
+    ScanCode<1u << kRelation>(dex_idx, method_id, [&](ScanRelation, uint64_t key, uint32_t) {
+        count += InRanges(keys, static_cast<uint32_t>(key));
+    });
+    return count;
+}
+
+template <DexHelper::ScanRelation kRelation>
+bool DexHelper::FindRelatedMethods(size_t dex_idx, const IdRanges &keys,
+                                   const MethodFilter &filter, bool find_first,
+                                   std::vector<size_t> &out,
+                                   std::vector<uint32_t> *found_keys) const {
+    const auto &cache = *GetScanCaches(dex_idx).lists[kRelation];
+    auto any_cached = [&] {
+        for (const auto &[lower, upper] : keys) {
+            for (auto key = lower; key < upper; ++key) {
+                if (!cache[key].empty()) return true;
+            }
         }
-        for (auto method_id = 0zu; method_id < codes.size(); ++method_id) {
-            auto &scanned = searched_methods_[dex_idx];
+        return false;
+    };
+    auto append = [&](size_t method_idx, uint32_t key) {
+        out.emplace_back(method_idx);
+        if (found_keys) found_keys->emplace_back(key);
+    };
+    return WithMethodMatcher(dex_idx, filter, [&](auto is_match) {
+        if (find_first) {
+            for (const auto &[lower, upper] : keys) {
+                for (auto key = lower; key < upper; ++key) {
+                    for (const auto &m : cache[key]) {
+                        if (is_match(m)) {
+                            append(CreateMethodIndex(dex_idx, m), key);
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        // a fully scanned dex has all its answers cached already
+        const auto plan = fully_scanned_[dex_idx].load(std::memory_order_acquire)
+                              ? MethodPlan{}
+                              : PlanMethodScan(dex_idx, filter);
+        auto &scanned = searched_methods_[dex_idx];
+        std::vector<uint32_t> used;
+        for (auto i = plan.first; i < plan.last; ++i) {
+            const auto method_id = plan[i];
             if (scanned[method_id]) continue;
-            if (IsMethodMatch(
-                    dex_idx, method_id,
-                    return_type == size_t(-1) ? uint32_t(-2)
-                                              : class_indices_[return_type][dex_idx],
-                    parameter_count, parameter_shorty,
-                    declaring_class == size_t(-1) ? uint32_t(-2)
-                                                  : class_indices_[declaring_class][dex_idx],
-                    parameter_types_ids[dex_idx], contains_parameter_types_ids[dex_idx])) {
+            if (!is_match(method_id)) continue;
+            if (no_cache_) {
+                // the cached list below only holds methods scanned before, once per use
+                used.clear();
+                ScanCode<1u << kRelation>(dex_idx, method_id,
+                                          [&](ScanRelation, uint64_t key, uint32_t) {
+                                              if (InRanges(keys, static_cast<uint32_t>(key))) {
+                                                  used.emplace_back(key);
+                                              }
+                                          });
+                if (used.empty()) continue;
+                const auto method_idx = CreateMethodIndex(dex_idx, method_id);
+                if (find_first) {
+                    append(method_idx, used[0]);
+                    return true;
+                }
+                for (auto key : used) append(method_idx, key);
+            } else {
                 ScanMethod(dex_idx, method_id);
-                if (find_first && !cache.empty()) break;
+                if (find_first && any_cached()) break;
             }
         }
-        for (const auto &setter : cache) {
-            if (IsMethodMatch(dex_idx, setter,
-                              return_type_id,
-                              parameter_count, parameter_shorty,
-                              declaring_class_id,
-                              parameter_types_ids[dex_idx],
-                              contains_parameter_types_ids[dex_idx])) {
-                out.emplace_back(CreateMethodIndex(dex_idx, setter));
-                if (find_first) return out;
+        for (const auto &[lower, upper] : keys) {
+            for (auto key = lower; key < upper; ++key) {
+                for (const auto &m : cache[key]) {
+                    if (is_match(m)) {
+                        append(CreateMethodIndex(dex_idx, m), key);
+                        if (find_first) return true;
+                    }
+                }
             }
         }
+        return false;
+    });
+}
+
+std::vector<size_t> DexHelper::FindMethodBySignature(size_t return_type,
+                                                     const std::vector<size_t> &parameter_types,
+                                                     std::string_view parameter_shorty,
+                                                     const std::vector<size_t> &dex_priority,
+                                                     bool find_first) const {
+    std::vector<size_t> out;
+
+    if (return_type != size_t(-1) && return_type >= class_indices_.size()) return out;
+    const auto [parameter_types_ids, contains_parameter_types_ids] =
+        ConvertParameters(parameter_types, {});
+    for (auto dex_idx : GetPriority(dex_priority)) {
+        EnsureDex(dex_idx);
+        // the signature index never grows, so no dex lock is needed
+        const auto filter = GetMethodFilter(dex_idx, return_type, -1, parameter_shorty, size_t(-1),
+                                            parameter_types_ids[dex_idx],
+                                            contains_parameter_types_ids[dex_idx]);
+        bool found = WithMethodMatcher(dex_idx, filter, [&](auto is_match) {
+            const auto plan = PlanMethodScan(dex_idx, filter);
+            for (auto i = plan.first; i < plan.last; ++i) {
+                const auto method_id = plan[i];
+                if (is_match(method_id)) {
+                    out.emplace_back(CreateMethodIndex(dex_idx, method_id));
+                    if (find_first) return true;
+                }
+            }
+            return false;
+        });
+        if (found) return out;
     }
     return out;
 }
+
 std::vector<size_t> DexHelper::FindField(size_t type, const std::vector<size_t> &dex_priority,
                                          bool find_first) const {
     std::vector<size_t> out;
 
     if (type >= class_indices_.size()) return out;
-    auto &type_ids = class_indices_[type];
+    const auto type_ids = class_indices_[type];
     for (auto dex_idx : GetPriority(dex_priority)) {
         const auto type_id = type_ids[dex_idx];
         if (type_id == dex::kNoIndex) continue;
+        EnsureDex(dex_idx);
         for (auto &field_id : declaring_cache_[dex_idx][type_id]) {
             out.emplace_back(CreateFieldIndex(dex_idx, field_id));
             if (find_first) return out;
@@ -624,21 +1872,315 @@ std::vector<size_t> DexHelper::FindField(size_t type, const std::vector<size_t>
     return out;
 }
 
-bool DexHelper::IsMethodMatch(size_t dex_id, uint32_t method_id, uint32_t return_type,
-                              short parameter_count, std::string_view parameter_shorty,
-                              uint32_t declaring_class,
-                              const std::vector<uint32_t> &parameter_types,
-                              const std::vector<uint32_t> &contains_parameter_types) const {
+std::vector<size_t> DexHelper::FindSubclasses(size_t class_idx, bool transitive) const {
+    return FindSubtypes(class_idx, false, transitive);
+}
+
+std::vector<size_t> DexHelper::FindImplementations(size_t interface_idx) const {
+    return FindSubtypes(interface_idx, true, true);
+}
+
+std::vector<size_t> DexHelper::FindSuperclasses(size_t class_idx) const {
+    std::vector<size_t> out;
+
+    if (class_idx >= class_indices_.size()) return out;
+    // a malformed dex may have cycles
+    phmap::flat_hash_set<size_t> found{class_idx};
+    for (auto current = class_idx; current != size_t(-1);) {
+        const auto type_ids = class_indices_[current];
+        current = size_t(-1);
+        for (auto [dex_idx, type_id] : type_ids) {
+            EnsureDex(dex_idx);
+            const auto class_def_idx = class_cache_[dex_idx][type_id];
+            if (class_def_idx == dex::kNoIndex) continue;
+            const auto superclass = readers_[dex_idx].ClassDefs()[class_def_idx].superclass_idx;
+            if (superclass == dex::kNoIndex) break;
+            current = CreateClassIndex(dex_idx, superclass);
+            if (!found.insert(current).second) return out;
+            out.emplace_back(current);
+            break;
+        }
+    }
+    return out;
+}
+
+std::vector<size_t> DexHelper::FindSubtypes(size_t class_idx, bool implementations,
+                                            bool transitive) const {
+    std::vector<size_t> out;
+
+    if (class_idx >= class_indices_.size()) return out;
+    phmap::flat_hash_set<size_t> found{class_idx};
+    auto add = [&](size_t dex_idx, uint32_t type_id) {
+        if (auto index = CreateClassIndex(dex_idx, type_id); found.insert(index).second) {
+            out.emplace_back(index);
+        }
+    };
+    // out doubles as the queue of the classes whose subtypes are still to be added
+    for (auto next = 0zu, current = class_idx;; current = out[next++]) {
+        const auto type_ids = class_indices_[current];
+        for (auto [dex_idx, type_id] : type_ids) {
+            EnsureHierarchy(dex_idx);
+            for (auto subclass : subclass_cache_[dex_idx][type_id]) add(dex_idx, subclass);
+            if (!implementations) continue;
+            for (auto implementation : implementation_cache_[dex_idx][type_id]) {
+                add(dex_idx, implementation);
+            }
+        }
+        if (!transitive || next == out.size()) break;
+    }
+    return out;
+}
+
+void DexHelper::EnsureHierarchy(size_t dex_idx) const {
+    EnsureDex(dex_idx);
+    std::call_once(hierarchy_built_[dex_idx], [this, dex_idx] {
+        const auto &dex = readers_[dex_idx];
+        std::vector<std::pair<uint32_t, uint32_t>> extends;
+        std::vector<std::pair<uint32_t, uint32_t>> implements;
+        for (const auto &class_def : dex.ClassDefs()) {
+            if (class_def.superclass_idx != dex::kNoIndex) {
+                extends.emplace_back(class_def.superclass_idx, class_def.class_idx);
+            }
+            if (class_def.interfaces_off == 0) continue;
+            const auto *interfaces = dex.dataPtr<dex::TypeList>(class_def.interfaces_off);
+            for (auto i = 0zu; i < interfaces->size; ++i) {
+                implements.emplace_back(interfaces->list[i].type_idx, class_def.class_idx);
+            }
+        }
+        auto [subclass_offsets, subclasses] = GroupByKey(dex.TypeIds().size(), extends);
+        subclass_cache_[dex_idx].assign(std::move(subclass_offsets), std::move(subclasses));
+        auto [implementation_offsets, implementations] = GroupByKey(dex.TypeIds().size(), implements);
+        implementation_cache_[dex_idx].assign(std::move(implementation_offsets),
+                                              std::move(implementations));
+
+        const auto &methods = dex.MethodIds();
+        std::vector<uint32_t> overrides(methods.size());
+        std::iota(overrides.begin(), overrides.end(), 0u);
+        // stable, so each group stays in method_id order
+        std::stable_sort(overrides.begin(), overrides.end(), [&](uint32_t a, uint32_t b) {
+            return std::pair(methods[a].name_idx, methods[a].proto_idx) <
+                   std::pair(methods[b].name_idx, methods[b].proto_idx);
+        });
+        override_cache_[dex_idx].assign(std::move(overrides));
+
+        std::vector<MethodDeclaration> declarations(methods.size(), kUndeclared);
+        for (const auto &class_def : dex.ClassDefs()) {
+            if (class_def.class_data_off == 0) continue;
+            const auto *class_data = dex.dataPtr<dex::u1>(class_def.class_data_off);
+            dex::u4 static_fields_count = dex::ReadULeb128(&class_data);
+            dex::u4 instance_fields_count = dex::ReadULeb128(&class_data);
+            dex::u4 direct_methods_count = dex::ReadULeb128(&class_data);
+            dex::u4 virtual_methods_count = dex::ReadULeb128(&class_data);
+            for (dex::u4 i = 0; i < (static_fields_count + instance_fields_count) * 2; ++i) {
+                dex::ReadULeb128(&class_data);
+            }
+            for (dex::u4 i = 0, method_idx = 0; i < direct_methods_count; ++i) {
+                method_idx += dex::ReadULeb128(&class_data);
+                dex::ReadULeb128(&class_data);
+                dex::ReadULeb128(&class_data);
+                declarations[method_idx] = kDirectMethod;
+            }
+            for (dex::u4 i = 0, method_idx = 0; i < virtual_methods_count; ++i) {
+                method_idx += dex::ReadULeb128(&class_data);
+                dex::ReadULeb128(&class_data);
+                dex::ReadULeb128(&class_data);
+                declarations[method_idx] = kVirtualMethod;
+            }
+        }
+        method_declarations_[dex_idx] = std::move(declarations);
+        hierarchy_ready_[dex_idx].store(true, std::memory_order_release);
+    });
+}
+
+uint32_t DexHelper::FindProtoId(size_t dex_idx, size_t from_dex_idx, uint32_t from_proto_id) const {
+    if (dex_idx == from_dex_idx) return from_proto_id;
+    const auto &dex = readers_[dex_idx];
+    const auto &from = readers_[from_dex_idx];
+    const auto &proto = from.ProtoIds()[from_proto_id];
+    const auto shorty_id =
+        FindPrefixStringIdExact(dex_idx, GetString(from_dex_idx, proto.shorty_idx));
+    if (shorty_id == dex::kNoIndex) return dex::kNoIndex;
+    auto same_type = [&](uint32_t type_id, uint32_t from_type_id) {
+        return GetString(dex_idx, dex.TypeIds()[type_id].descriptor_idx) ==
+               GetString(from_dex_idx, from.TypeIds()[from_type_id].descriptor_idx);
+    };
+    const auto *params =
+        proto.parameters_off ? from.dataPtr<dex::TypeList>(proto.parameters_off) : nullptr;
+    for (auto proto_id : shorty_cache_[dex_idx][shorty_id]) {
+        const auto &candidate = dex.ProtoIds()[proto_id];
+        if (!same_type(candidate.return_type_idx, proto.return_type_idx)) continue;
+        // the same shorty has as many parameters
+        if (!params) return proto_id;
+        const auto *candidate_params = dex.dataPtr<dex::TypeList>(candidate.parameters_off);
+        auto i = 0zu;
+        while (i < params->size &&
+               same_type(candidate_params->list[i].type_idx, params->list[i].type_idx)) {
+            ++i;
+        }
+        if (i == params->size) return proto_id;
+    }
+    return dex::kNoIndex;
+}
+
+std::span<const uint32_t> DexHelper::GetOverrideGroup(size_t dex_idx, uint32_t name_id,
+                                                      uint32_t proto_id) const {
+    const auto &methods = readers_[dex_idx].MethodIds();
+    const auto &overrides = override_cache_[dex_idx];
+    const std::pair<uint32_t, uint32_t> key(name_id, proto_id);
+    auto signature = [&](uint32_t method_id) {
+        const auto &method = methods[method_id];
+        return std::pair<uint32_t, uint32_t>(method.name_idx, method.proto_idx);
+    };
+    const auto *first =
+        std::lower_bound(overrides.begin(), overrides.end(), key,
+                         [&](uint32_t m, const auto &k) { return signature(m) < k; });
+    const auto *last =
+        std::upper_bound(first, overrides.end(), key,
+                         [&](const auto &k, uint32_t m) { return k < signature(m); });
+    return {first, last};
+}
+
+auto DexHelper::FindDispatchingMethodIds(size_t method_idx) const -> std::vector<IdRanges> {
+    std::vector<IdRanges> out(readers_.size());
+    const auto method_ids = method_indices_[method_idx];
+    if (method_ids.begin() == method_ids.end()) return out;
+    // the first dex having the method names it
+    const auto [from_dex_idx, from_method_id] = *method_ids.begin();
+    EnsureDex(from_dex_idx);
+    const auto &method = readers_[from_dex_idx].MethodIds()[from_method_id];
+    const auto name = GetString(from_dex_idx, method.name_idx);
+
+    // groups[dex] -> the refs with the name and proto of the method in each dex. a subtype
+    // may be declared in any dex referencing its supertype, and java.lang.Object is referenced
+    // by all of them, so every hierarchy is needed however narrow the callers' dex_priority is
+    std::vector<std::span<const uint32_t>> groups(readers_.size());
+    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+        EnsureHierarchy(dex_idx);
+        const auto name_id = FindPrefixStringIdExact(dex_idx, name);
+        if (name_id == dex::kNoIndex) continue;
+        const auto proto_id = FindProtoId(dex_idx, from_dex_idx, method.proto_idx);
+        if (proto_id == dex::kNoIndex) continue;
+        groups[dex_idx] = GetOverrideGroup(dex_idx, name_id, proto_id);
+    }
+    // how the first dex defining class_idx declares the method on it
+    auto declaration = [&](size_t class_idx) {
+        const auto type_ids = class_indices_[class_idx];
+        for (auto [dex_idx, type_id] : type_ids) {
+            if (class_cache_[dex_idx][type_id] == dex::kNoIndex) continue;
+            // method_ids sort by class first
+            const auto &methods = readers_[dex_idx].MethodIds();
+            const auto &group = groups[dex_idx];
+            auto method_id = std::lower_bound(
+                group.begin(), group.end(), type_id,
+                [&](uint32_t m, uint32_t t) { return methods[m].class_idx < t; });
+            if (method_id == group.end() || methods[*method_id].class_idx != type_id) {
+                return kUndeclared;
+            }
+            return method_declarations_[dex_idx][*method_id];
+        }
+        return kUndeclared;
+    };
+
+    const auto class_idx = CreateClassIndex(from_dex_idx, method.class_idx);
+    const bool is_virtual = declaration(class_idx) != kDirectMethod;
+    phmap::flat_hash_set<size_t> found{class_idx};
+    // the class and the subtypes inheriting the method from it, nearer ones first
+    std::vector<size_t> types{class_idx};
+    for (auto next = 0zu; next < types.size(); ++next) {
+        const auto type_ids = class_indices_[types[next]];
+        for (auto [dex_idx, type_id] : type_ids) {
+            auto add = [&](uint32_t subtype_id) {
+                const auto subtype = CreateClassIndex(dex_idx, subtype_id);
+                if (!found.insert(subtype).second) return;
+                // calls naming an override or a hiding method never reach the method
+                if (declaration(subtype) != kUndeclared) return;
+                types.emplace_back(subtype);
+            };
+            for (auto subclass : subclass_cache_[dex_idx][type_id]) add(subclass);
+            if (!is_virtual) continue;
+            for (auto implementation : implementation_cache_[dex_idx][type_id]) add(implementation);
+        }
+    }
+    if (is_virtual) {
+        // every type above those, whose calls may dispatch down to it
+        for (auto superclass : FindSuperclasses(class_idx)) {
+            if (found.insert(superclass).second) types.emplace_back(superclass);
+        }
+        for (auto next = 0zu; next < types.size(); ++next) {
+            const auto type_ids = class_indices_[types[next]];
+            for (auto [dex_idx, type_id] : type_ids) {
+                const auto class_def_idx = class_cache_[dex_idx][type_id];
+                if (class_def_idx == dex::kNoIndex) continue;
+                const auto &dex = readers_[dex_idx];
+                const auto interfaces_off = dex.ClassDefs()[class_def_idx].interfaces_off;
+                if (interfaces_off == 0) continue;
+                const auto *interfaces = dex.dataPtr<dex::TypeList>(interfaces_off);
+                for (auto i = 0zu; i < interfaces->size; ++i) {
+                    const auto interface = CreateClassIndex(dex_idx, interfaces->list[i].type_idx);
+                    if (found.insert(interface).second) types.emplace_back(interface);
+                }
+            }
+        }
+    }
+
+    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+        if (groups[dex_idx].empty()) continue;
+        phmap::flat_hash_set<uint32_t> type_ids;
+        for (auto type : types) {
+            if (auto type_id = class_indices_[type][dex_idx]; type_id != dex::kNoIndex) {
+                type_ids.insert(type_id);
+            }
+        }
+        const auto &methods = readers_[dex_idx].MethodIds();
+        for (auto method_id : groups[dex_idx]) {
+            if (type_ids.contains(methods[method_id].class_idx)) {
+                out[dex_idx].emplace_back(method_id, method_id + 1);
+            }
+        }
+    }
+    return out;
+}
+
+auto DexHelper::GetMethodFilter(size_t dex_idx, size_t return_type, short parameter_count,
+                                std::string_view parameter_shorty, size_t declaring_class,
+                                const std::vector<uint32_t> &parameter_types,
+                                const std::vector<uint32_t> &contains_parameter_types) const
+    -> MethodFilter {
+    return {.return_type = return_type == size_t(-1) ? uint32_t(-2) : class_indices_[return_type][dex_idx],
+            .parameter_count = parameter_count,
+            .shorty = parameter_shorty.empty() ? uint32_t(-2) : FindPrefixStringIdExact(dex_idx, parameter_shorty),
+            .declaring_class = declaring_class == size_t(-1) ? uint32_t(-2) : class_indices_[declaring_class][dex_idx],
+            .parameter_types = &parameter_types,
+            .contains_parameter_types = &contains_parameter_types};
+}
+
+unsigned DexHelper::GetMatchFilters(const MethodFilter &filter) {
+    return (filter.declaring_class != uint32_t(-2) ? unsigned(kMatchDeclaringClass) : 0u) |
+           (filter.return_type != uint32_t(-2) ? unsigned(kMatchReturnType) : 0u) |
+           (filter.shorty != uint32_t(-2) ? unsigned(kMatchShorty) : 0u) |
+           (filter.parameter_count != -1 || !filter.parameter_types->empty() ||
+                    !filter.contains_parameter_types->empty()
+                ? unsigned(kMatchParameters)
+                : 0u);
+}
+
+auto DexHelper::GetMethodMatcher(const MethodFilter &filter) -> MethodMatcher {
+    static constexpr auto kMatchers = []<unsigned... kFilters>(std::integer_sequence<unsigned, kFilters...>) {
+        return std::array<MethodMatcher, sizeof...(kFilters)>{&DexHelper::IsMethodMatch<kFilters>...};
+    }(std::make_integer_sequence<unsigned, kMatchFilterCount>());
+    return kMatchers[GetMatchFilters(filter)];
+}
+
+bool DexHelper::IsProtoMatch(size_t dex_id, uint32_t proto_id, const MethodFilter &filter) const {
     const auto &dex = readers_[dex_id];
-    const auto &method = dex.MethodIds()[method_id];
-    const auto &strs = strings_[dex_id];
-    if (declaring_class != uint32_t(-2) && method.class_idx != declaring_class) return false;
-    const auto &proto = dex.ProtoIds()[method.proto_idx];
-    const auto &shorty = strs[proto.shorty_idx];
-    if (return_type != uint32_t(-2) && proto.return_type_idx != return_type) return false;
-    if (!parameter_shorty.empty() && shorty != parameter_shorty) return false;
+    const auto &proto = dex.ProtoIds()[proto_id];
+    const auto parameter_count = filter.parameter_count;
+    const auto &parameter_types = *filter.parameter_types;
+    const auto &contains_parameter_types = *filter.contains_parameter_types;
+    if (filter.return_type != uint32_t(-2) && proto.return_type_idx != filter.return_type) return false;
+    if (filter.shorty != uint32_t(-2) && proto.shorty_idx != filter.shorty) return false;
     if (parameter_count != -1 || !parameter_types.empty() || !contains_parameter_types.empty()) {
-        auto param_off = dex.ProtoIds()[method.proto_idx].parameters_off;
+        auto param_off = proto.parameters_off;
         const auto *params = param_off ? dex.dataPtr<dex::TypeList>(param_off) : nullptr;
         const auto params_size = params ? params->size : 0zu;
         if (parameter_count != -1 && params_size != parameter_count) return false;
@@ -663,48 +2205,153 @@ bool DexHelper::IsMethodMatch(size_t dex_id, uint32_t method_id, uint32_t return
     }
     return true;
 }
+
+auto DexHelper::PlanMethodScan(size_t dex_idx, const MethodFilter &filter) const -> MethodPlan {
+    const auto return_type = filter.return_type;
+    const auto parameter_count = filter.parameter_count;
+    const auto shorty = filter.shorty;
+    const auto declaring_class = filter.declaring_class;
+    const auto &parameter_types = *filter.parameter_types;
+    const auto &contains_parameter_types = *filter.contains_parameter_types;
+    const auto &dex = readers_[dex_idx];
+    const auto &methods = dex.MethodIds();
+    const auto &protos = dex.ProtoIds();
+    MethodPlan plan;
+
+    // the protos a match can have: a list from the signature index, or a run of proto ids
+    std::span<const uint32_t> proto_list;
+    bool listed = false;
+    uint32_t proto_first = 0;
+    uint32_t proto_last = protos.size();
+    auto narrow = [&](std::span<const uint32_t> candidates) {
+        if (listed ? candidates.size() < proto_list.size() : candidates.size() < proto_last - proto_first) {
+            proto_list = candidates;
+            listed = true;
+        }
+    };
+    // a filter naming nothing in this dex matches no method at all
+    if (return_type != uint32_t(-2)) {
+        // proto ids are sorted by return type, so its protos are one run
+        auto first = std::partition_point(protos.begin(), protos.end(), [return_type](const dex::ProtoId &p) {
+            return p.return_type_idx < return_type;
+        });
+        auto last = std::partition_point(first, protos.end(), [return_type](const dex::ProtoId &p) {
+            return p.return_type_idx == return_type;
+        });
+        if (first == last) return plan;
+        proto_first = first - protos.begin();
+        proto_last = last - protos.begin();
+    }
+    if (shorty != uint32_t(-2)) {
+        if (shorty == dex::kNoIndex) return plan;
+        narrow(shorty_cache_[dex_idx][shorty]);
+    }
+    for (const auto *types : {&parameter_types, &contains_parameter_types}) {
+        for (auto type : *types) {
+            if (type == uint32_t(-2)) continue;
+            if (type == dex::kNoIndex) return plan;
+            narrow(parameter_cache_[dex_idx][type]);
+        }
+    }
+
+    uint32_t first = 0;
+    uint32_t last = methods.size();
+    if (declaring_class != uint32_t(-2)) {
+        // method ids are sorted by declaring class, so its methods are one run
+        first = std::partition_point(methods.begin(), methods.end(), [declaring_class](const dex::MethodId &m) {
+            return m.class_idx < declaring_class;
+        }) - methods.begin();
+        last = std::partition_point(methods.begin() + first, methods.end(), [declaring_class](const dex::MethodId &m) {
+            return m.class_idx == declaring_class;
+        }) - methods.begin();
+    }
+
+    // listing the methods of the candidate protos only pays off if they are fewer than the run
+    const auto &by_proto = proto_cache_[dex_idx];
+    auto proto_count = listed ? proto_list.size() : proto_last - proto_first;
+    if (proto_count < protos.size()) {
+        auto method_count = 0zu;
+        for (auto i = 0zu; i < proto_count; ++i) {
+            method_count += by_proto[listed ? proto_list[i] : proto_first + i].size();
+        }
+        if (method_count < last - first) {
+            for (auto i = 0zu; i < proto_count; ++i) {
+                auto proto_id = listed ? proto_list[i] : proto_first + i;
+                if (!IsProtoMatch(dex_idx, proto_id, filter)) continue;
+                for (auto method_id : by_proto[proto_id]) {
+                    if (method_id >= first && method_id < last) plan.methods.emplace_back(method_id);
+                }
+            }
+            std::sort(plan.methods.begin(), plan.methods.end());
+            plan.last = plan.methods.size();
+            return plan;
+        }
+    }
+
+    const auto first_parameter = parameter_types.empty() ? uint32_t(-2) : parameter_types[0];
+    const auto parameters_count = parameter_types.empty() ? -1 : static_cast<int>(parameter_types.size());
+    if (return_type == uint32_t(-2) && shorty == uint32_t(-2) && parameter_count == -1 &&
+        parameters_count == -1) {
+        plan.first = first;
+        plan.last = last;
+        return plan;
+    }
+    // the columns rule out most of the run in one branchless pass, only what passes is
+    // left for IsMethodMatch to check against the full parameter lists
+    const auto &columns = method_columns_[dex_idx];
+    const bool any_return_type = return_type == uint32_t(-2);
+    const bool any_shorty = shorty == uint32_t(-2);
+    const bool any_parameter_count = parameter_count == -1;
+    const bool any_parameters_count = parameters_count == -1;
+    const bool any_first_parameter = first_parameter == uint32_t(-2);
+    plan.methods.resize(last - first);
+    auto count = 0zu;
+    for (auto method_id = first; method_id < last; ++method_id) {
+        plan.methods[count] = method_id;
+        count += (any_return_type | (columns.return_types[method_id] == return_type)) &
+                 (any_shorty | (columns.shorties[method_id] == shorty)) &
+                 (any_parameter_count | (columns.parameter_counts[method_id] == parameter_count)) &
+                 (any_parameters_count | (columns.parameter_counts[method_id] == parameters_count)) &
+                 (any_first_parameter | (columns.first_parameters[method_id] == first_parameter));
+    }
+    plan.methods.resize(count);
+    plan.last = count;
+    return plan;
+}
 size_t DexHelper::CreateMethodIndex(std::string_view class_name, std::string_view method_name,
                                     const std::vector<std::string_view> &params_name) const {
     std::vector<uint32_t> method_ids;
     method_ids.resize(readers_.size(), dex::kNoIndex);
     bool created = false;
     for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
-        const auto &strs = strings_[dex_idx];
-        auto method_name_iter = std::lower_bound(strs.cbegin(), strs.cend(), method_name, utf8_less);
-        if (method_name_iter == strs.cend() || *method_name_iter != method_name) continue;
-        auto method_name_id = method_name_iter - strs.cbegin();
-        auto class_name_iter = std::lower_bound(strs.cbegin(), strs.cend(), class_name, utf8_less);
-        if (class_name_iter == strs.cend() || *class_name_iter != class_name) continue;
-        auto class_name_id = class_name_iter - strs.cbegin();
-        auto class_id = type_cache_[dex_idx][class_name_id];
+        const auto &dex = readers_[dex_idx];
+        auto method_name_id = FindPrefixStringIdExact(dex_idx, method_name);
+        if (method_name_id == dex::kNoIndex) continue;
+        auto class_name_id = FindPrefixStringIdExact(dex_idx, class_name);
+        if (class_name_id == dex::kNoIndex) continue;
+        auto class_id = FindTypeId(dex_idx, class_name_id);
         if (class_id == dex::kNoIndex) continue;
-        auto candidates = method_cache_[dex_idx][class_id].find(method_name_id);
-        if (candidates == method_cache_[dex_idx][class_id].end()) continue;
-        for (const auto &method_id : candidates->second) {
-            const auto &dex = readers_[dex_idx];
+        const auto &methods = dex.MethodIds();
+        auto [first, last] = std::equal_range(methods.begin(), methods.end(),
+                                              MemberLess::Key(class_id, method_name_id), MemberLess{});
+        for (auto method = first; method != last; ++method) {
+            uint32_t method_id = method - methods.begin();
             auto param_off = dex.ProtoIds()[dex.MethodIds()[method_id].proto_idx].parameters_off;
             const auto *params = param_off ? dex.dataPtr<dex::TypeList>(param_off) : nullptr;
             if (params && params->size != params_name.size()) continue;
             if (!params_name.empty() && !params) continue;
-            for (auto i = 0zu; i < params_name.size(); ++i) {
-                if (strs[dex.TypeIds()[params->list[i].type_idx].descriptor_idx] !=
-                    params_name[i]) {
-                    continue;
-                }
+            bool match = true;
+            for (auto i = 0zu; i < params_name.size() && match; ++i) {
+                match = GetString(dex_idx, dex.TypeIds()[params->list[i].type_idx].descriptor_idx) ==
+                        params_name[i];
             }
-            if (auto idx = rev_method_indices_[dex_idx][method_id]; idx != size_t(-1)) return idx;
+            if (!match) continue;
             created = true;
             method_ids[dex_idx] = method_id;
         }
     }
     if (!created) return -1;
-    auto index = method_indices_.size();
-    for (auto dex_id = 0zu; dex_id < readers_.size(); ++dex_id) {
-        auto method_id = method_ids[dex_id];
-        if (method_id != dex::kNoIndex) rev_method_indices_[dex_id][method_id] = index;
-    }
-    method_indices_.emplace_back(std::move(method_ids));
-    return index;
+    return AddIndex(method_indices_, rev_method_indices_, method_ids);
 }
 
 size_t DexHelper::CreateClassIndex(std::string_view class_name) const {
@@ -712,24 +2359,15 @@ size_t DexHelper::CreateClassIndex(std::string_view class_name) const {
     class_ids.resize(readers_.size(), dex::kNoIndex);
     bool created = false;
     for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
-        const auto &strs = strings_[dex_idx];
-        auto class_name_iter = std::lower_bound(strs.cbegin(), strs.cend(), class_name, utf8_less);
-        if (class_name_iter == strs.cend() || *class_name_iter != class_name) continue;
-        auto class_name_id = class_name_iter - strs.cbegin();
-        auto class_id = type_cache_[dex_idx][class_name_id];
+        auto class_name_id = FindPrefixStringIdExact(dex_idx, class_name);
+        if (class_name_id == dex::kNoIndex) continue;
+        auto class_id = FindTypeId(dex_idx, class_name_id);
         if (class_id == dex::kNoIndex) continue;
-        if (auto idx = rev_class_indices_[dex_idx][class_id]; idx != size_t(-1)) return idx;
         created = true;
         class_ids[dex_idx] = class_id;
     }
     if (!created) return -1;
-    auto index = class_indices_.size();
-    for (auto dex_id = 0zu; dex_id < readers_.size(); ++dex_id) {
-        auto class_id = class_ids[dex_id];
-        if (class_id != dex::kNoIndex) rev_class_indices_[dex_id][class_id] = index;
-    }
-    class_indices_.emplace_back(std::move(class_ids));
-    return index;
+    return AddIndex(class_indices_, rev_class_indices_, class_ids);
 }
 
 size_t DexHelper::CreateFieldIndex(std::string_view class_name, std::string_view field_name) const {
@@ -738,33 +2376,46 @@ size_t DexHelper::CreateFieldIndex(std::string_view class_name, std::string_view
 
     bool created = false;
     for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
-        const auto &strs = strings_[dex_idx];
-        auto class_name_iter = std::lower_bound(strs.cbegin(), strs.cend(), class_name, utf8_less);
-        if (class_name_iter == strs.cend() || *class_name_iter != class_name) continue;
-        auto class_name_id = class_name_iter - strs.cbegin();
-        auto field_name_iter = std::lower_bound(strs.cbegin(), strs.cend(), field_name, utf8_less);
-        if (field_name_iter == strs.cend() || *field_name_iter != field_name) continue;
-        auto field_name_id = field_name_iter - strs.cbegin();
-        auto class_id = type_cache_[dex_idx][class_name_id];
+        auto class_name_id = FindPrefixStringIdExact(dex_idx, class_name);
+        if (class_name_id == dex::kNoIndex) continue;
+        auto field_name_id = FindPrefixStringIdExact(dex_idx, field_name);
+        if (field_name_id == dex::kNoIndex) continue;
+        auto class_id = FindTypeId(dex_idx, class_name_id);
         if (class_id == dex::kNoIndex) continue;
-        auto iter = field_cache_[dex_idx][class_id].find(field_name_id);
-        if (iter == field_cache_[dex_idx][class_id].end()) continue;
-        auto field_id = iter->second;
-        if (auto idx = rev_field_indices_[dex_idx][field_id]; idx != size_t(-1)) return idx;
+        const auto &fields = readers_[dex_idx].FieldIds();
+        auto [first, last] = std::equal_range(fields.begin(), fields.end(),
+                                              MemberLess::Key(class_id, field_name_id), MemberLess{});
+        if (first == last) continue;
+        // fields sharing a name but not a type resolve to the last one
+        uint32_t field_id = last - 1 - fields.begin();
         created = true;
         field_ids[dex_idx] = field_id;
     }
     if (!created) return -1;
-    auto index = field_indices_.size();
-    for (auto dex_id = 0zu; dex_id < readers_.size(); ++dex_id) {
-        auto field_id = field_ids[dex_id];
-        if (field_id != dex::kNoIndex) rev_field_indices_[dex_id][field_id] = index;
+    return AddIndex(field_indices_, rev_field_indices_, field_ids);
+}
+
+size_t DexHelper::AddIndex(IndexTable &indices, std::vector<std::vector<size_t>> &rev,
+                           const std::vector<uint32_t> &ids) const {
+    // resolved without the lock, so another thread may have added the same entry meanwhile
+    std::lock_guard lock(index_mutex_);
+    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+        if (ids[dex_idx] == dex::kNoIndex) continue;
+        if (auto idx = rev[dex_idx][ids[dex_idx]]; idx != size_t(-1)) return idx;
+    }
+    std::vector<IndexTable::Member> members;
+    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+        if (ids[dex_idx] != dex::kNoIndex) members.push_back({uint32_t(dex_idx), ids[dex_idx]});
     }
-    field_indices_.emplace_back(std::move(field_ids));
+    auto index = indices.push_back(members);
+    for (auto [dex_idx, id] : members) rev[dex_idx][id] = index;
     return index;
 }
 
 size_t DexHelper::CreateMethodIndex(size_t dex_idx, uint32_t method_id) const {
+    if (global_indices_ready_.load(std::memory_order_acquire)) {
+        return rev_method_indices_[dex_idx][method_id];
+    }
     const auto &dex = readers_[dex_idx];
     const auto &strs = strings_[dex_idx];
     const auto &method = dex.MethodIds()[method_id];
@@ -782,12 +2433,18 @@ size_t DexHelper::CreateMethodIndex(size_t dex_idx, uint32_t method_id) const {
 }
 
 size_t DexHelper::CreateClassIndex(size_t dex_idx, uint32_t class_id) const {
+    if (global_indices_ready_.load(std::memory_order_acquire)) {
+        return rev_class_indices_[dex_idx][class_id];
+    }
     const auto &dex = readers_[dex_idx];
     const auto &strs = strings_[dex_idx];
     return CreateClassIndex(strs[dex.TypeIds()[class_id].descriptor_idx]);
 }
 
 size_t DexHelper::CreateFieldIndex(size_t dex_idx, uint32_t field_id) const {
+    if (global_indices_ready_.load(std::memory_order_acquire)) {
+        return rev_field_indices_[dex_idx][field_id];
+    }
     const auto &dex = readers_[dex_idx];
     const auto &strs = strings_[dex_idx];
     const auto &field = dex.FieldIds()[field_id];
@@ -795,14 +2452,138 @@ size_t DexHelper::CreateFieldIndex(size_t dex_idx, uint32_t field_id) const {
                             strs[field.name_idx]);
 }
 
+void DexHelper::CreateGlobalIndices() const {
+    if (global_indices_ready_.load(std::memory_order_acquire)) return;
+    std::call_once(global_indices_built_, [this] { BuildGlobalIndices(); });
+}
+
+auto DexHelper::GroupMembers(const std::vector<std::span<const uint32_t>> &keys, size_t key_count)
+    -> std::pair<std::vector<uint32_t>, std::vector<IndexTable::Member>> {
+    std::vector<uint32_t> offsets(key_count + 1);
+    for (const auto &dex_keys : keys) {
+        for (auto key : dex_keys) ++offsets[key + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<IndexTable::Member> members(offsets.back());
+    // ends[key] -> past the members of key so far
+    std::vector<uint32_t> ends(offsets.begin(), offsets.end() - 1);
+    for (auto dex_idx = 0zu; dex_idx < keys.size(); ++dex_idx) {
+        for (auto id = 0zu; id < keys[dex_idx].size(); ++id) {
+            const auto key = keys[dex_idx][id];
+            auto &end = ends[key];
+            // a malformed dex repeating a symbol keeps its last id for it
+            if (end != offsets[key] && members[end - 1].dex == dex_idx) {
+                members[end - 1].id = id;
+            } else {
+                members[end++] = {uint32_t(dex_idx), uint32_t(id)};
+            }
+        }
+    }
+    // close the gaps repeated ids left
+    auto size = 0u;
+    for (auto key = 0zu; key < key_count; ++key) {
+        const auto begin = offsets[key];
+        offsets[key] = size;
+        for (auto i = begin; i < ends[key]; ++i) members[size++] = members[i];
+    }
+    offsets[key_count] = size;
+    members.resize(size);
+    return {std::move(offsets), std::move(members)};
+}
+
+void DexHelper::BuildGlobalIndices() const {
+    const auto dex_count = readers_.size();
+    // keys[dex][id] -> dense number of its descriptor, equal across dexs for the same symbol.
+    // a method is keyed by its class, name and proto, a field by its class, name and type
+    std::vector<std::vector<uint32_t>> type_keys(dex_count);
+    std::vector<std::vector<uint32_t>> method_keys(dex_count);
+    std::vector<std::vector<uint32_t>> field_keys(dex_count);
+    phmap::flat_hash_map<std::string_view, uint32_t> types;
+    // protos by their return and parameter type keys as raw bytes
+    phmap::flat_hash_map<std::string, uint32_t> protos;
+    phmap::flat_hash_map<std::pair<uint64_t, std::string_view>, uint32_t> methods;
+    phmap::flat_hash_map<std::pair<uint64_t, std::string_view>, uint32_t> fields;
+    std::vector<uint32_t> proto_keys;
+    std::string proto;
+    for (auto dex_idx = 0zu; dex_idx < dex_count; ++dex_idx) {
+        EnsureDex(dex_idx);
+        const auto &dex = readers_[dex_idx];
+        const auto &strs = strings_[dex_idx];
+        auto &type_key = type_keys[dex_idx];
+        type_key.resize(dex.TypeIds().size());
+        for (auto type_id = 0zu; type_id < type_key.size(); ++type_id) {
+            auto descriptor = strs[dex.TypeIds()[type_id].descriptor_idx];
+            type_key[type_id] = types.try_emplace(descriptor, types.size()).first->second;
+        }
+        proto_keys.resize(dex.ProtoIds().size());
+        for (auto proto_id = 0zu; proto_id < proto_keys.size(); ++proto_id) {
+            const auto &proto_def = dex.ProtoIds()[proto_id];
+            auto append = [&proto](uint32_t key) {
+                proto.append(reinterpret_cast<const char *>(&key), sizeof(key));
+            };
+            proto.clear();
+            append(type_key[proto_def.return_type_idx]);
+            if (proto_def.parameters_off) {
+                const auto *params = dex.dataPtr<dex::TypeList>(proto_def.parameters_off);
+                for (auto i = 0zu; i < params->size; ++i) append(type_key[params->list[i].type_idx]);
+            }
+            proto_keys[proto_id] = protos.try_emplace(proto, protos.size()).first->second;
+        }
+        auto &method_key = method_keys[dex_idx];
+        method_key.resize(dex.MethodIds().size());
+        for (auto method_id = 0zu; method_id < method_key.size(); ++method_id) {
+            const auto &method = dex.MethodIds()[method_id];
+            auto key = std::pair(uint64_t(type_key[method.class_idx]) << 32 | proto_keys[method.proto_idx],
+                                 strs[method.name_idx]);
+            method_key[method_id] = methods.try_emplace(key, methods.size()).first->second;
+        }
+        auto &field_key = field_keys[dex_idx];
+        field_key.resize(dex.FieldIds().size());
+        for (auto field_id = 0zu; field_id < field_key.size(); ++field_id) {
+            const auto &field = dex.FieldIds()[field_id];
+            auto key = std::pair(uint64_t(type_key[field.class_idx]) << 32 | type_key[field.type_idx],
+                                 strs[field.name_idx]);
+            field_key[field_id] = fields.try_emplace(key, fields.size()).first->second;
+        }
+    }
+
+    // a key with an index created on demand keeps it, the other ones are appended
+    auto assign = [](IndexTable &indices, std::vector<std::vector<size_t>> &rev,
+                     const std::vector<std::vector<uint32_t>> &keys, size_t key_count) {
+        const auto [offsets, members] = GroupMembers(
+            std::vector<std::span<const uint32_t>>(keys.begin(), keys.end()), key_count);
+        std::vector<size_t> key_indices(key_count);
+        for (auto key = 0zu; key < key_count; ++key) {
+            const std::span<const IndexTable::Member> row(members.begin() + offsets[key],
+                                                          members.begin() + offsets[key + 1]);
+            auto index = size_t(-1);
+            for (auto it = row.begin(); it != row.end() && index == size_t(-1); ++it) {
+                index = rev[it->dex][it->id];
+            }
+            key_indices[key] = index != size_t(-1) ? index : indices.push_back(row);
+        }
+        // also covers ids of a malformed dex repeating a symbol, which are not in members
+        for (auto dex_idx = 0zu; dex_idx < keys.size(); ++dex_idx) {
+            for (auto id = 0zu; id < keys[dex_idx].size(); ++id) {
+                if (rev[dex_idx][id] == size_t(-1)) rev[dex_idx][id] = key_indices[keys[dex_idx][id]];
+            }
+        }
+    };
+    {
+        std::lock_guard lock(index_mutex_);
+        assign(class_indices_, rev_class_indices_, type_keys, types.size());
+        assign(method_indices_, rev_method_indices_, method_keys, methods.size());
+        assign(field_indices_, rev_field_indices_, field_keys, fields.size());
+    }
+    global_indices_ready_.store(true, std::memory_order_release);
+}
+
 auto DexHelper::DecodeClass(size_t class_idx) const -> Class {
     if (class_idx >= class_indices_.size()) return {};
-    auto &class_ids = class_indices_[class_idx];
-    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
-        auto class_id = class_ids[dex_idx];
-        if (class_id == dex::kNoIndex) continue;
+    const auto class_ids = class_indices_[class_idx];
+    for (auto [dex_idx, class_id] : class_ids) {
         return {
-            .name = strings_[dex_idx][readers_[dex_idx].TypeIds()[class_id].descriptor_idx],
+            .name = GetString(dex_idx, readers_[dex_idx].TypeIds()[class_id].descriptor_idx),
         };
     }
     return {};
@@ -810,20 +2591,17 @@ auto DexHelper::DecodeClass(size_t class_idx) const -> Class {
 
 auto DexHelper::DecodeField(size_t field_idx) const -> Field {
     if (field_idx >= field_indices_.size()) return {};
-    auto &field_ids = field_indices_[field_idx];
-    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
-        auto field_id = field_ids[dex_idx];
-        if (field_id == dex::kNoIndex) continue;
+    const auto field_ids = field_indices_[field_idx];
+    for (auto [dex_idx, field_id] : field_ids) {
         const auto &dex = readers_[dex_idx];
         const auto &field = dex.FieldIds()[field_id];
-        const auto &strs = strings_[dex_idx];
         return {
             .declaring_class =
                 {
-                    .name = strs[dex.TypeIds()[field.class_idx].descriptor_idx],
+                    .name = GetString(dex_idx, dex.TypeIds()[field.class_idx].descriptor_idx),
                 },
-            .type = {.name = strs[dex.TypeIds()[field.type_idx].descriptor_idx]},
-            .name = strings_[dex_idx][field.name_idx],
+            .type = {.name = GetString(dex_idx, dex.TypeIds()[field.type_idx].descriptor_idx)},
+            .name = GetString(dex_idx, field.name_idx),
         };
     }
     return {};
@@ -831,31 +2609,28 @@ auto DexHelper::DecodeField(size_t field_idx) const -> Field {
 
 auto DexHelper::DecodeMethod(size_t method_idx) const -> Method {
     if (method_idx >= method_indices_.size()) return {};
-    auto &method_ids = method_indices_[method_idx];
-    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
-        auto method_id = method_ids[dex_idx];
-        if (method_id == dex::kNoIndex) continue;
+    const auto method_ids = method_indices_[method_idx];
+    for (auto [dex_idx, method_id] : method_ids) {
         const auto &dex = readers_[dex_idx];
         const auto &method = dex.MethodIds()[method_id];
-        const auto &strs = strings_[dex_idx];
         std::vector<Class> parameters;
         auto param_off = dex.ProtoIds()[dex.MethodIds()[method_id].proto_idx].parameters_off;
         const auto *params = param_off ? dex.dataPtr<dex::TypeList>(param_off) : nullptr;
         auto params_size = params ? params->size : 0zu;
         for (auto i = 0zu; i < params_size; ++i) {
             parameters.emplace_back(Class{
-                .name = strs[dex.TypeIds()[params->list[i].type_idx].descriptor_idx],
+                .name = GetString(dex_idx, dex.TypeIds()[params->list[i].type_idx].descriptor_idx),
             });
         }
         return {.declaring_class =
                     {
-                        .name = strs[dex.TypeIds()[method.class_idx].descriptor_idx],
+                        .name = GetString(dex_idx, dex.TypeIds()[method.class_idx].descriptor_idx),
                     },
-                .name = strs[method.name_idx],
+                .name = GetString(dex_idx, method.name_idx),
                 .parameters = std::move(parameters),
                 .return_type = {
-                    .name = strs[dex.TypeIds()[dex.ProtoIds()[method.proto_idx].return_type_idx]
-                                     .descriptor_idx]}};
+                    .name = GetString(dex_idx, dex.TypeIds()[dex.ProtoIds()[method.proto_idx].return_type_idx]
+                                                   .descriptor_idx)}};
     }
     return {};
 }
@@ -0,0 +1,272 @@
+#include "dex_builder.h"
+#include "dex_helper.h"
+#include <chrono>
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <fcntl.h>
+#include <iostream>
+#include <malloc.h>
+#include <parallel_hashmap/phmap.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "slicer/reader.h"
+
+// Measures how fast filters pass over the methods of a generated dex of about 65k methods,
+// the size where a dex runs out of method ids. every method uses the string "benchmark".
+// dex files given on the command line are scanned too, for code as compilers emit it.
+// construction time, resident memory and member lookups are measured on a corpus of several
+// such dexs and on the given ones.
+
+using namespace startop::dex;
+
+namespace {
+constexpr size_t kClassCount = 511;
+constexpr size_t kMethodsPerClass = 128;
+constexpr int kRounds = 50;
+constexpr int kScanRounds = 10;
+constexpr size_t kCorpusDexCount = 3;
+
+slicer::MemView GenerateDex(DexBuilder &dex_file, const std::string &package = "benchmark.") {
+  // built here rather than at namespace scope, where the descriptors copied from
+  // dex_builder.cc may not be initialized yet
+  const std::vector<TypeDescriptor> kTypes = {
+      TypeDescriptor::Int, TypeDescriptor::Long, TypeDescriptor::Boolean,
+      TypeDescriptor::String, TypeDescriptor::Object,
+  };
+  // the code of a method is only copied when the image is created
+  std::deque<MethodBuilder> methods;
+  const auto &callee = dex_file.GetOrDeclareMethod(TypeDescriptor::FromClassname(package + "C0"),
+                                                   "m0", Prototype{TypeDescriptor::Int, {}});
+  for (size_t c = 0; c < kClassCount; ++c) {
+    ClassBuilder cbuilder{dex_file.MakeClass(package + "C" + std::to_string(c))};
+    for (size_t m = 0; m < kMethodsPerClass; ++m) {
+      // spreads the methods over 1 + 5 + 25 + 125 parameter lists and 6 return types
+      std::vector<TypeDescriptor> params;
+      for (auto seed = m + c; params.size() < seed % 4; seed /= kTypes.size()) {
+        params.push_back(kTypes[seed % kTypes.size()]);
+      }
+      auto return_type = (m + c) % 6 == 5 ? TypeDescriptor::Void : kTypes[(m + c) % 6];
+      auto &method = methods.emplace_back(
+          cbuilder.CreateMethod("m" + std::to_string(m), Prototype{return_type, params}));
+      {
+        LiveRegister r{method.AllocRegister()};
+        method.BuildConstString(r, "benchmark");
+      }
+      method.AddInstruction(Instruction::InvokeStatic(callee.id, {}));
+      method.BuildReturn();
+      method.Encode();
+    }
+  }
+  return dex_file.CreateImage();
+}
+
+template <typename Query>
+void Run(const char *name, size_t method_count, Query &&query) {
+  size_t found = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRounds; ++i) {
+    found = query().size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  std::cout << name << ": " << found << " found, "
+            << method_count * kRounds / elapsed.count() / 1e6 << "M methods/s" << std::endl;
+}
+
+// full scans of a fresh helper, without building its tables
+void RunScan(const char *name,
+             const std::vector<std::tuple<const void *, size_t, const void *, size_t>> &dexs) {
+  size_t bytes = 0;
+  for (const auto &dex : dexs) {
+    bytes += std::get<1>(dex);
+  }
+  std::chrono::duration<double> elapsed{};
+  for (int i = 0; i < kScanRounds; ++i) {
+    DexHelper helper(dexs);
+    auto begin = std::chrono::steady_clock::now();
+    helper.CreateFullCache();
+    elapsed += std::chrono::steady_clock::now() - begin;
+  }
+  std::cout << name << ": " << bytes * kScanRounds / elapsed.count() / 1e6 << "M dex bytes/s"
+            << std::endl;
+}
+// resident set size in bytes
+size_t ResidentBytes() {
+  size_t total = 0, resident = 0;
+  std::ifstream("/proc/self/statm") >> total >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// bytes allocated and not freed, which unlike the resident set does not hide allocations
+// reusing pages freed earlier
+size_t HeapBytes() {
+#ifdef __GLIBC__
+  return mallinfo2().uordblks;
+#else
+  return mallinfo().uordblks;
+#endif
+}
+
+std::string MemoryDelta(size_t rss, size_t heap) {
+  return "RSS +" + std::to_string((ResidentBytes() - rss) / 1e6) + " MB, heap +" +
+         std::to_string((HeapBytes() - heap) / 1e6) + " MB";
+}
+
+// construction of a helper over dexs, and resolving every member of them through the sorted
+// method and field id sections it searches against the per-type hash maps it used to build
+void RunConstruction(
+    const char *name, const std::vector<std::tuple<const void *, size_t, const void *, size_t>> &dexs) {
+  std::vector<dex::Reader> readers;
+  for (const auto &[image, size, data, data_size] : dexs) {
+    readers.emplace_back(static_cast<const dex::u1 *>(image), size,
+                         static_cast<const dex::u1 *>(data), data_size);
+  }
+
+  auto lookup = [&](const char *variant, auto &&build, auto &&find) {
+    auto rss = ResidentBytes(), heap = HeapBytes();
+    auto begin = std::chrono::steady_clock::now();
+    auto tables = build();
+    std::chrono::duration<double, std::milli> built = std::chrono::steady_clock::now() - begin;
+    size_t found = 0, lookups = 0;
+    begin = std::chrono::steady_clock::now();
+    for (auto dex_idx = 0zu; dex_idx < readers.size(); ++dex_idx) {
+      for (const auto &method : readers[dex_idx].MethodIds()) {
+        found += find(tables, dex_idx, method.class_idx, method.name_idx, true);
+      }
+      for (const auto &field : readers[dex_idx].FieldIds()) {
+        found += find(tables, dex_idx, field.class_idx, field.name_idx, false);
+      }
+      lookups += readers[dex_idx].MethodIds().size() + readers[dex_idx].FieldIds().size();
+    }
+    std::chrono::duration<double, std::milli> looked_up = std::chrono::steady_clock::now() - begin;
+    std::cout << name << " member lookup, " << variant << ": build " << built.count()
+              << " ms, " << MemoryDelta(rss, heap) << ", " << found << "/"
+              << lookups << " found in " << looked_up.count() << " ms" << std::endl;
+    // kept until the end, so that the next measurement does not reuse its pages
+    return tables;
+  };
+
+  // maps[dex][class_idx] -> name_idx -> id, one map per type for methods and one for fields
+  using MemberMaps = std::vector<std::vector<phmap::flat_hash_map<uint32_t, uint32_t>>>;
+  const auto maps = lookup("per-type hash maps",
+         [&] {
+           std::pair<MemberMaps, MemberMaps> maps;
+           for (const auto &reader : readers) {
+             auto &methods = maps.first.emplace_back(reader.TypeIds().size());
+             auto &fields = maps.second.emplace_back(reader.TypeIds().size());
+             for (auto id = 0u; id < reader.MethodIds().size(); ++id) {
+               const auto &method = reader.MethodIds()[id];
+               methods[method.class_idx].emplace(method.name_idx, id);
+             }
+             for (auto id = 0u; id < reader.FieldIds().size(); ++id) {
+               const auto &field = reader.FieldIds()[id];
+               fields[field.class_idx].emplace(field.name_idx, id);
+             }
+           }
+           return maps;
+         },
+         [](const auto &maps, size_t dex_idx, uint32_t class_idx, uint32_t name_idx, bool method) {
+           const auto &map = (method ? maps.first : maps.second)[dex_idx][class_idx];
+           return map.find(name_idx) != map.end();
+         });
+  lookup("sorted id sections", [] { return 0; },
+         [&](int, size_t dex_idx, uint32_t class_idx, uint32_t name_idx, bool method) {
+           auto less = [](const auto &a, const auto &b) {
+             return std::pair(a.class_idx, a.name_idx) < std::pair(b.class_idx, b.name_idx);
+           };
+           const auto &reader = readers[dex_idx];
+           if (method) {
+             const dex::MethodId key{.class_idx = dex::u2(class_idx), .name_idx = name_idx};
+             return std::binary_search(reader.MethodIds().begin(), reader.MethodIds().end(), key, less);
+           }
+           const dex::FieldId key{.class_idx = dex::u2(class_idx), .name_idx = name_idx};
+           return std::binary_search(reader.FieldIds().begin(), reader.FieldIds().end(), key, less);
+         });
+  {
+    auto rss = ResidentBytes(), heap = HeapBytes();
+    auto begin = std::chrono::steady_clock::now();
+    DexHelper helper(dexs);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    std::cout << name << " construction: " << elapsed.count() << " ms, "
+              << MemoryDelta(rss, heap) << std::endl;
+  }
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  DexBuilder dex_file;
+  slicer::MemView image{GenerateDex(dex_file)};
+  // a multi-dex app, each dex of its own classes
+  std::deque<DexBuilder> corpus_files(kCorpusDexCount);
+  std::vector<slicer::MemView> corpus_images;
+  std::vector<std::tuple<const void *, size_t, const void *, size_t>> corpus;
+  for (auto i = 0zu; i < kCorpusDexCount; ++i) {
+    corpus_images.push_back(GenerateDex(corpus_files[i], "corpus" + std::to_string(i) + "."));
+    corpus.emplace_back(corpus_images.back().ptr<const void>(), corpus_images.back().size(), nullptr, 0);
+  }
+  RunConstruction("generated corpus", corpus);
+  RunScan("full scan", {{image.ptr<const void>(), image.size(), nullptr, 0}});
+  std::vector<std::tuple<const void *, size_t, const void *, size_t>> dexs;
+  for (int i = 1; i < argc; ++i) {
+    int fd = open(argv[i], O_RDONLY);
+    if (fd == -1) {
+      std::cerr << "cannot open " << argv[i] << std::endl;
+      return 1;
+    }
+    struct stat s {};
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &s) == 0 && s.st_size > 0) {
+      mapped = mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      std::cerr << "cannot map " << argv[i] << std::endl;
+      return 1;
+    }
+    dexs.emplace_back(mapped, s.st_size, nullptr, 0);
+  }
+  if (!dexs.empty()) {
+    RunScan("full scan of given dexs", dexs);
+    RunConstruction("given dexs", dexs);
+  }
+
+  DexHelper helper({{image.ptr<const void>(), image.size(), nullptr, 0}});
+  const auto method_count = kClassCount * kMethodsPerClass;
+
+  auto int_idx = helper.CreateClassIndex("I");
+  auto string_idx = helper.CreateClassIndex("Ljava/lang/String;");
+  auto object_idx = helper.CreateClassIndex("Ljava/lang/Object;");
+
+  Run("parameter count", method_count, [&] {
+    return helper.FindMethodBySignature(size_t(-1), {size_t(-1)}, "", {}, false);
+  });
+  Run("return type", method_count, [&] {
+    return helper.FindMethodBySignature(int_idx, {}, "", {}, false);
+  });
+  Run("return type + first parameter", method_count, [&] {
+    return helper.FindMethodBySignature(int_idx, {string_idx, size_t(-1)}, "", {}, false);
+  });
+  Run("shorty", method_count, [&] {
+    return helper.FindMethodBySignature(size_t(-1), {}, "LIL", {}, false);
+  });
+  Run("parameter types", method_count, [&] {
+    return helper.FindMethodBySignature(size_t(-1), {object_idx, int_idx, string_idx}, "", {}, false);
+  });
+
+  // these match every method listed under the string
+  helper.CreateFullCache();
+  auto class_idx = helper.CreateClassIndex("Lbenchmark/C7;");
+  Run("string + declaring class", method_count, [&] {
+    return helper.FindMethodUsingString("benchmark", false, -1, -1, "", class_idx, {}, {}, {}, false);
+  });
+  Run("string + return type + parameter count", method_count, [&] {
+    return helper.FindMethodUsingString("benchmark", false, int_idx, 2, "", -1, {}, {}, {}, false);
+  });
+  Run("string + shorty", method_count, [&] {
+    return helper.FindMethodUsingString("benchmark", false, -1, -1, "LIL", -1, {}, {}, {}, false);
+  });
+}
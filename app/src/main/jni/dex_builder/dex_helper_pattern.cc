@@ -0,0 +1,438 @@
+#include "dex_helper.h"
+
+#include <algorithm>
+#include <bitset>
+#include <functional>
+#include <limits>
+#include <numeric>
+
+// Substring and regex search over the string pool of a dex. Every string is indexed under
+// the hashes of its 3-byte windows, so a pattern only has to be checked against the strings
+// holding all the trigrams it cannot match without.
+namespace {
+constexpr unsigned kTrigramBits = 16;
+
+uint32_t TrigramKey(const char *p) {
+    auto trigram = uint32_t(uint8_t(p[0])) << 16 | uint32_t(uint8_t(p[1])) << 8 | uint8_t(p[2]);
+    return (trigram * 2654435761u) >> (32 - kTrigramBits);
+}
+
+// one byte of the pattern, repeated as its quantifier allows
+struct Atom {
+    std::bitset<256> chars;
+    bool optional = false;  // '?' or '*'
+    bool repeat = false;    // '+' or '*'
+};
+
+// an alternative of the pattern, without any '|'
+struct Branch {
+    std::vector<Atom> atoms;
+    bool anchor_begin = false;
+    bool anchor_end = false;
+};
+
+std::bitset<256> CharRange(uint8_t first, uint8_t last) {
+    std::bitset<256> chars;
+    for (auto c = unsigned(first); c <= last; ++c) chars.set(c);
+    return chars;
+}
+
+// \d \w \s and their negations, false for any other class escape
+bool ClassEscape(char c, std::bitset<256> &chars) {
+    switch (c) {
+        case 'd':
+        case 'D':
+            chars = CharRange('0', '9');
+            break;
+        case 'w':
+        case 'W':
+            chars = CharRange('0', '9') | CharRange('a', 'z') | CharRange('A', 'Z');
+            chars.set('_');
+            break;
+        case 's':
+        case 'S':
+            chars = CharRange('\t', '\r');
+            chars.set(' ');
+            break;
+        default:
+            return false;
+    }
+    if (c >= 'A' && c <= 'Z') chars.flip();
+    return true;
+}
+
+// the byte of an escape standing for a single character, false if there is none
+bool CharEscape(char c, uint8_t &out) {
+    switch (c) {
+        case 'n':
+            out = '\n';
+            return true;
+        case 'r':
+            out = '\r';
+            return true;
+        case 't':
+            out = '\t';
+            return true;
+        case 'f':
+            out = '\f';
+            return true;
+        case 'v':
+            out = '\v';
+            return true;
+        case '0':
+            out = '\0';
+            return true;
+        default:
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+                return false;
+            }
+            out = c;
+            return true;
+    }
+}
+
+// a bracket class starting after its '[', leaves pos after its ']'
+bool ParseClass(std::string_view pattern, size_t &pos, std::bitset<256> &chars) {
+    bool negate = pos < pattern.size() && pattern[pos] == '^';
+    if (negate) ++pos;
+    while (pos < pattern.size() && pattern[pos] != ']') {
+        uint8_t low;
+        if (pattern[pos] == '\\') {
+            if (++pos == pattern.size()) return false;
+            std::bitset<256> escaped;
+            if (ClassEscape(pattern[pos], escaped)) {
+                chars |= escaped;
+                ++pos;
+                continue;
+            }
+            if (!CharEscape(pattern[pos], low)) return false;
+        } else {
+            low = pattern[pos];
+        }
+        ++pos;
+        if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+            uint8_t high = pattern[++pos];
+            if (high == '\\') {
+                if (++pos == pattern.size() || !CharEscape(pattern[pos], high)) return false;
+            }
+            ++pos;
+            if (high < low) return false;
+            chars |= CharRange(low, high);
+        } else {
+            chars.set(low);
+        }
+    }
+    if (pos == pattern.size()) return false;
+    ++pos;
+    if (negate) chars.flip();
+    return true;
+}
+
+bool ParseRegex(std::string_view pattern, std::vector<Branch> &branches) {
+    branches.emplace_back();
+    // just after the quantifier of the last atom, where a '?' makes it lazy
+    auto quantifier_end = std::string_view::npos;
+    for (size_t pos = 0; pos < pattern.size();) {
+        auto &branch = branches.back();
+        auto c = pattern[pos++];
+        switch (c) {
+            case '|':
+                branches.emplace_back();
+                continue;
+            case '^':
+                if (!branch.atoms.empty() || branch.anchor_begin) return false;
+                branch.anchor_begin = true;
+                continue;
+            case '$':
+                if (pos < pattern.size() && pattern[pos] != '|') return false;
+                branch.anchor_end = true;
+                continue;
+            case '*':
+            case '+':
+            case '?': {
+                if (branch.atoms.empty()) return false;
+                auto &atom = branch.atoms.back();
+                // one quantifier per atom, lazy quantifiers match the same strings
+                if (atom.optional || atom.repeat) {
+                    if (c != '?' || pos - 1 != quantifier_end) return false;
+                    quantifier_end = std::string_view::npos;
+                    continue;
+                }
+                atom.optional = c != '+';
+                atom.repeat = c != '?';
+                quantifier_end = pos;
+                continue;
+            }
+            case '(':
+            case ')':
+            case '{':
+                return false;
+        }
+        Atom atom;
+        if (c == '.') {
+            atom.chars.set().reset('\n').reset('\r');
+        } else if (c == '[') {
+            if (!ParseClass(pattern, pos, atom.chars)) return false;
+        } else if (c == '\\') {
+            if (pos == pattern.size()) return false;
+            uint8_t literal;
+            if (!ClassEscape(pattern[pos], atom.chars)) {
+                if (!CharEscape(pattern[pos], literal)) return false;
+                atom.chars.set(literal);
+            }
+            ++pos;
+        } else {
+            atom.chars.set(uint8_t(c));
+        }
+        branch.atoms.push_back(atom);
+    }
+    return true;
+}
+
+// whether str has a match of branch. every way of matching is followed at once, as the set
+// of atoms the matches so far have reached, so the time is linear in str for any pattern,
+// where backtracking would be polynomial in patterns like a*a*a*a*b
+bool MatchBranch(const Branch &branch, std::string_view str) {
+    const auto &atoms = branch.atoms;
+    // states[i] -> some match so far has matched the atoms before i
+    std::vector<uint8_t> states(atoms.size() + 1);
+    std::vector<uint8_t> next(atoms.size() + 1);
+    // i and the atoms an optional atom at i lets a match skip to
+    auto add = [&](std::vector<uint8_t> &set, size_t i) {
+        while (!set[i]) {
+            set[i] = true;
+            if (i == atoms.size() || !atoms[i].optional) break;
+            ++i;
+        }
+    };
+    add(states, 0);
+    for (size_t pos = 0;; ++pos) {
+        if (states.back() && (!branch.anchor_end || pos == str.size())) return true;
+        if (pos == str.size()) return false;
+        std::fill(next.begin(), next.end(), false);
+        bool any = false;
+        for (size_t i = 0; i < atoms.size(); ++i) {
+            if (!states[i] || !atoms[i].chars[uint8_t(str[pos])]) continue;
+            if (atoms[i].repeat) add(next, i);
+            add(next, i + 1);
+            any = true;
+        }
+        // an unanchored match may start at any byte
+        if (!branch.anchor_begin) {
+            add(next, 0);
+        } else if (!any) {
+            return false;
+        }
+        states.swap(next);
+    }
+}
+
+// the trigram keys of the literal runs every match of branch contains
+std::vector<uint32_t> BranchTrigrams(const Branch &branch) {
+    std::vector<uint32_t> keys;
+    std::string run;
+    auto flush = [&] {
+        for (size_t i = 0; i + 3 <= run.size(); ++i) keys.push_back(TrigramKey(run.data() + i));
+        run.clear();
+    };
+    for (const auto &atom : branch.atoms) {
+        if (atom.optional || atom.chars.count() != 1) {
+            flush();
+            continue;
+        }
+        // the single set bit
+        auto c = 0u;
+        while (!atom.chars[c]) ++c;
+        run.push_back(char(c));
+        // a repeated byte starts a run of its own after this one
+        if (atom.repeat) {
+            flush();
+            run.push_back(char(c));
+        }
+    }
+    flush();
+    return keys;
+}
+
+// the str_ids listed under all of keys
+template <typename Index>
+std::vector<uint32_t> IntersectTrigrams(const Index &index, std::vector<uint32_t> keys) {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::sort(keys.begin(), keys.end(),
+              [&](uint32_t a, uint32_t b) { return index[a].size() < index[b].size(); });
+    auto first = index[keys.front()];
+    std::vector<uint32_t> candidates(first.begin(), first.end());
+    std::vector<uint32_t> next;
+    for (auto key = keys.begin() + 1; key != keys.end() && !candidates.empty(); ++key) {
+        auto list = index[*key];
+        next.clear();
+        if (candidates.size() * 16 < list.size()) {
+            // the list is much longer, look up each candidate in it
+            std::copy_if(candidates.begin(), candidates.end(), std::back_inserter(next),
+                         [&](uint32_t id) { return std::binary_search(list.begin(), list.end(), id); });
+        } else {
+            std::set_intersection(candidates.begin(), candidates.end(), list.begin(), list.end(),
+                                  std::back_inserter(next));
+        }
+        candidates.swap(next);
+    }
+    return candidates;
+}
+
+// the Levenshtein distance of a and b, or max_distance + 1 if it is more
+size_t EditDistance(std::string_view a, std::string_view b, size_t max_distance,
+                    std::vector<size_t> &row) {
+    if (a.size() > b.size()) std::swap(a, b);
+    if (b.size() - a.size() > max_distance) return max_distance + 1;
+    // row[j] -> the distance of the part of a read so far and b[0, j)
+    row.resize(b.size() + 1);
+    std::iota(row.begin(), row.end(), 0zu);
+    for (size_t i = 1; i <= a.size(); ++i) {
+        auto diagonal = row[0];
+        row[0] = i;
+        auto row_min = row[0];
+        for (size_t j = 1; j <= b.size(); ++j) {
+            auto next = std::min({row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] != b[j - 1])});
+            diagonal = row[j];
+            row[j] = next;
+            row_min = std::min(row_min, next);
+        }
+        // distances never shrink further down
+        if (row_min > max_distance) return max_distance + 1;
+    }
+    return std::min(row.back(), max_distance + 1);
+}
+
+void AppendId(std::vector<std::pair<uint32_t, uint32_t>> &ranges, uint32_t id) {
+    if (!ranges.empty() && ranges.back().second == id) {
+        ++ranges.back().second;
+    } else {
+        ranges.emplace_back(id, id + 1);
+    }
+}
+}  // namespace
+
+const DexHelper::PostingLists &DexHelper::GetTrigramIndex(size_t dex_idx) const {
+    std::call_once(trigrams_built_[dex_idx], [&] {
+        const auto &strs = strings_[dex_idx];
+        std::vector<uint32_t> offsets((size_t(1) << kTrigramBits) + 1, 0);
+        std::vector<uint32_t> keys;
+        // counted first so that the values of each key are filled in str_id order
+        auto string_keys = [&](uint32_t str_id) {
+            auto str = strs[str_id];
+            keys.clear();
+            for (size_t i = 0; i + 3 <= str.size(); ++i) keys.push_back(TrigramKey(str.data() + i));
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        };
+        for (uint32_t str_id = 0; str_id < strs.size(); ++str_id) {
+            string_keys(str_id);
+            for (auto key : keys) ++offsets[key + 1];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<uint32_t> values(offsets.back());
+        auto next = offsets;
+        for (uint32_t str_id = 0; str_id < strs.size(); ++str_id) {
+            string_keys(str_id);
+            for (auto key : keys) values[next[key]++] = str_id;
+        }
+        trigram_cache_[dex_idx].assign(std::move(offsets), std::move(values));
+        trigrams_ready_[dex_idx].store(true, std::memory_order_release);
+    });
+    return trigram_cache_[dex_idx];
+}
+
+bool DexHelper::FindMatchingStringIds(size_t dex_idx, std::string_view str, bool regex,
+                                      IdRanges &out) const {
+    std::vector<Branch> branches;
+    if (regex && !ParseRegex(str, branches)) return false;
+
+    const auto &strs = strings_[dex_idx];
+    const std::boyer_moore_horspool_searcher searcher(str.begin(), str.end());
+    auto matches = [&](uint32_t str_id) {
+        auto s = strs[str_id];
+        // an empty str is found at the end of an empty string too
+        if (!regex) return str.empty() || std::search(s.begin(), s.end(), searcher) != s.end();
+        return std::any_of(branches.begin(), branches.end(),
+                           [&](const Branch &branch) { return MatchBranch(branch, s); });
+    };
+
+    // the union over the branches of the strings holding all their trigrams, unless a branch
+    // has none and every string has to be checked
+    std::vector<uint32_t> candidates;
+    // with no_cache the index is not built for a one-shot lookup either
+    bool check_all = no_cache_;
+    auto add_candidates = [&](std::vector<uint32_t> &&keys) {
+        if (check_all) return;
+        if (keys.empty()) {
+            check_all = true;
+            return;
+        }
+        auto ids = IntersectTrigrams(GetTrigramIndex(dex_idx), std::move(keys));
+        candidates.insert(candidates.end(), ids.begin(), ids.end());
+    };
+    if (regex) {
+        for (const auto &branch : branches) {
+            if (check_all) break;
+            add_candidates(BranchTrigrams(branch));
+        }
+    } else {
+        std::vector<uint32_t> keys;
+        for (size_t i = 0; i + 3 <= str.size(); ++i) keys.push_back(TrigramKey(str.data() + i));
+        add_candidates(std::move(keys));
+    }
+    if (check_all) {
+        candidates.resize(strs.size());
+        std::iota(candidates.begin(), candidates.end(), 0u);
+    } else if (branches.size() > 1) {
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+
+    for (auto str_id : candidates) {
+        if (matches(str_id)) AppendId(out, str_id);
+    }
+    return true;
+}
+
+void DexHelper::FindSimilarStringIds(size_t dex_idx, std::string_view str, size_t max_distance,
+                                     std::vector<IdRanges> &out) const {
+    // no string is farther than this from any other
+    max_distance = std::min<size_t>(max_distance, std::numeric_limits<uint32_t>::max());
+    const auto &strs = strings_[dex_idx];
+    std::vector<uint32_t> keys;
+    for (size_t i = 0; i + 3 <= str.size(); ++i) keys.push_back(TrigramKey(str.data() + i));
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    // an edit breaks at most 3 trigrams of str, so a string within max_distance still holds all
+    // but 3 * max_distance of its distinct ones. with no_cache every string is checked instead
+    // of building the index
+    std::vector<uint32_t> candidates;
+    if (keys.size() > 3 * max_distance && !no_cache_) {
+        const auto needed = keys.size() - 3 * max_distance;
+        const auto &index = GetTrigramIndex(dex_idx);
+        std::vector<uint32_t> shared(strs.size(), 0);
+        for (auto key : keys) {
+            for (auto str_id : index[key]) {
+                if (++shared[str_id] == needed) candidates.push_back(str_id);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+    } else {
+        candidates.resize(strs.size());
+        std::iota(candidates.begin(), candidates.end(), 0u);
+    }
+
+    std::vector<size_t> row;
+    for (auto str_id : candidates) {
+        auto s = strs[str_id];
+        auto length_difference = s.size() > str.size() ? s.size() - str.size() : str.size() - s.size();
+        if (length_difference > max_distance) continue;
+        auto distance = EditDistance(str, s, max_distance, row);
+        if (distance > max_distance) continue;
+        if (out.size() <= distance) out.resize(distance + 1);
+        AppendId(out[distance], str_id);
+    }
+}
@@ -0,0 +1,218 @@
+#include <chrono>
+#include <map>
+#include <regex>
+#include <set>
+
+#include "dex_helper_testing.h"
+
+// Checks FindMethodUsingSubstring, plain and regex, against std::regex and std::string on the
+// strings of generated dexs: a pattern must find the methods of every string it matches.
+
+using namespace dex_helper_testing;
+
+namespace {
+const std::vector<size_t> kAny;
+
+std::vector<std::string> RandomStrings(std::mt19937 &random) {
+  // characters, not bytes, to keep the strings valid MUTF-8
+  static const std::vector<std::string> kAlphabet = {"a", "a", "b", "b", "c", "A", "B",
+                                                     "1", ".", "_", "-", " ", "\n", "\xc3\xa9"};
+  std::vector<std::string> strings = {"", "a", "ab", "abc", "aaaa", "abcabc", "a.b", "A_1",
+                                      "line\nbreak", "1.2.3"};
+  while (strings.size() < 150) {
+    std::string s;
+    for (auto length = random() % 12; length > 0; --length) {
+      s += kAlphabet[random() % kAlphabet.size()];
+    }
+    if (std::find(strings.begin(), strings.end(), s) == strings.end()) strings.push_back(s);
+  }
+  return strings;
+}
+
+// a pattern of the subset FindMethodUsingSubstring supports
+std::string RandomPattern(std::mt19937 &random) {
+  static const std::vector<std::string> kAtoms = {"a", "b", "c", "A", "1", ".", "\\.", "_",
+                                                  "-", " ", "[a-c]", "[^ab]", "\\d", "\\w",
+                                                  "\\s", "\\W", "\\n", "[.\\-]"};
+  static const std::vector<std::string> kQuantifiers = {"", "", "", "*", "+", "?", "*?", "+?"};
+  std::string pattern;
+  for (auto branches = 1 + random() % 3; branches > 0; --branches) {
+    if (!pattern.empty()) pattern += "|";
+    if (random() % 4 == 0) pattern += "^";
+    for (auto atoms = random() % 5; atoms > 0; --atoms) {
+      pattern += kAtoms[random() % kAtoms.size()] + kQuantifiers[random() % kQuantifiers.size()];
+    }
+    if (random() % 4 == 0) pattern += "$";
+  }
+  return pattern;
+}
+
+// the methods using any of the strings matches accepts, by the exact string query
+std::vector<std::string> ExpectedUsers(const DexHelper &helper,
+                                       const std::vector<std::string> &strings,
+                                       const std::function<bool(const std::string &)> &matches) {
+  std::vector<size_t> methods;
+  for (const auto &str : strings) {
+    if (!matches(str)) continue;
+    auto users = helper.FindMethodUsingString(str, false, -1, -1, "", -1, kAny, kAny, kAny, false);
+    methods.insert(methods.end(), users.begin(), users.end());
+  }
+  return Signatures(helper, methods);
+}
+
+void TestPatterns(const TestDexs &dexs, const DexHelper &helper, std::mt19937 &random) {
+  std::vector<std::string> patterns = {
+      // alternations, whose trigrams come from every branch
+      "abc|1.2", "abcabc|xyz", "^abc|bc$", "aaa|b", "zzz|yyy",
+      // too short for a trigram, every string is checked
+      "", "a", "ab", ".", "^", "$", "^$", "a|b",
+      // runs broken by classes and quantifiers
+      "ab+c", "a[b]c", "aa*a", "abc?", "a.b", "\\d\\.\\d", "line\\nbreak", "[^a-z]+"};
+  while (patterns.size() < 400) patterns.push_back(RandomPattern(random));
+
+  for (const auto &pattern : patterns) {
+    std::regex regex(pattern, std::regex::ECMAScript);
+    ExpectEqual("regex \"" + pattern + "\"",
+                ExpectedUsers(helper, dexs.strings,
+                              [&](const std::string &s) { return std::regex_search(s, regex); }),
+                Signatures(helper, helper.FindMethodUsingSubstring(pattern, true, -1, -1, "", -1,
+                                                                   kAny, kAny, kAny, false)));
+  }
+  for (const auto &str : dexs.strings) {
+    for (auto length = 0zu; length <= str.size(); ++length) {
+      auto substring = str.substr(str.size() - length);
+      ExpectEqual("substring \"" + substring + "\"",
+                  ExpectedUsers(helper, dexs.strings,
+                                [&](const std::string &s) {
+                                  return s.find(substring) != std::string::npos;
+                                }),
+                  Signatures(helper, helper.FindMethodUsingSubstring(
+                                         substring, false, -1, -1, "", -1, kAny, kAny, kAny,
+                                         false)));
+    }
+  }
+  // outside the subset, these find nothing rather than something else
+  for (const auto *pattern : {"(a)", "a{2}", "a**", "[b-a]", "[ab", "\\", "*a", "a^", "$a"}) {
+    Expect(std::string("invalid regex ") + pattern,
+           helper.FindMethodUsingSubstring(pattern, true, -1, -1, "", -1, kAny, kAny, kAny, false)
+               .empty());
+  }
+}
+
+// the byte Levenshtein distance, the whole table
+size_t Distance(const std::string &a, const std::string &b) {
+  std::vector<std::vector<size_t>> table(a.size() + 1, std::vector<size_t>(b.size() + 1));
+  for (size_t i = 0; i <= a.size(); ++i) {
+    for (size_t j = 0; j <= b.size(); ++j) {
+      if (i == 0 || j == 0) {
+        table[i][j] = i + j;
+      } else {
+        table[i][j] = std::min({table[i - 1][j] + 1, table[i][j - 1] + 1,
+                                table[i - 1][j - 1] + (a[i - 1] != b[j - 1])});
+      }
+    }
+  }
+  return table[a.size()][b.size()];
+}
+
+// str with edits random insertions, deletions and substitutions
+std::string Edit(std::string str, size_t edits, std::mt19937 &random) {
+  static const std::string kBytes = "abc1.-";
+  for (; edits > 0; --edits) {
+    auto pos = str.empty() ? 0 : random() % (str.size() + 1);
+    auto byte = kBytes[random() % kBytes.size()];
+    switch (random() % 3) {
+      case 0:
+        str.insert(str.begin() + pos, byte);
+        break;
+      case 1:
+        if (pos < str.size()) str.erase(pos, 1);
+        break;
+      case 2:
+        if (pos < str.size()) str[pos] = byte;
+        break;
+    }
+  }
+  return str;
+}
+
+// every method using a string within max_distance, listed once, at its nearest string
+void TestSimilar(const TestDexs &dexs, const DexHelper &helper, std::mt19937 &random) {
+  std::vector<std::string> queries = {"", "a", "ab", "abc", "aaaaaaaa", "abcabcabc"};
+  for (const auto &str : dexs.strings) {
+    queries.push_back(str);
+    queries.push_back(Edit(str, 1 + random() % 3, random));
+  }
+  for (const auto &str : queries) {
+    for (size_t max_distance : {0zu, 1zu, 2zu, 3zu, 5zu, size_t(-1)}) {
+      std::map<std::string, size_t> nearest;
+      for (const auto &method : dexs.methods) {
+        for (const auto &used : method.strings) {
+          auto distance = Distance(str, used);
+          if (distance > max_distance) continue;
+          auto [it, added] = nearest.emplace(method.Signature(), distance);
+          if (!added) it->second = std::min(it->second, distance);
+        }
+      }
+      std::vector<std::string> expected;
+      for (const auto &[signature, distance] : nearest) expected.push_back(signature);
+      auto found = helper.FindMethodUsingSimilarString(str, max_distance, -1, -1, "", -1, kAny, kAny,
+                                                       kAny, false);
+      auto name = "similar \"" + str + "\" within " + std::to_string(max_distance);
+      ExpectEqual(name, expected, Signatures(helper, found));
+      // nearer strings first
+      size_t last = 0;
+      for (auto method : found) {
+        auto distance = nearest[Signatures(helper, {method})[0]];
+        Expect(name + " order", distance >= last);
+        last = distance;
+      }
+      auto first = helper.FindMethodUsingSimilarString(str, max_distance, -1, -1, "", -1, kAny,
+                                                       kAny, kAny, true);
+      Expect(name + " find_first", found.empty() ? first.empty()
+                                                 : first.size() == 1 && first[0] == found[0]);
+    }
+  }
+}
+
+// backtracking takes polynomial time in the repeats here, matching stays linear
+void TestRepeats() {
+  TestDexs dexs({.dex_count = 1, .strings = {std::string(20000, 'a'), "aab"}});
+  DexHelper helper(dexs.dexs());
+  auto start = std::chrono::steady_clock::now();
+  ExpectEqual("repeats",
+              Signatures(helper, helper.FindMethodUsingString("aab", false, -1, -1, "", -1, kAny,
+                                                              kAny, kAny, false)),
+              Signatures(helper, helper.FindMethodUsingSubstring("a*a*a*a*a*a*a*a*b", true, -1, -1,
+                                                                 "", -1, kAny, kAny, kAny, false)));
+  Expect("repeats in linear time",
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+}
+}  // namespace
+
+int main() {
+  std::mt19937 random(1);
+  auto strings = RandomStrings(random);
+  TestDexs dexs({.classes_per_dex = 8, .methods_per_class = 8, .strings = strings});
+  for (bool no_cache : {false, true}) {
+    DexHelper helper(dexs.dexs(), 1, {}, false, no_cache);
+    TestPatterns(dexs, helper, random);
+  }
+  TestRepeats();
+
+  // longer strings over fewer bytes, many of them near each other, some repeating trigrams
+  std::vector<std::string> similar = {"aaaaaaaaaaaa", "abcabcabcabc", "version 1.2.3"};
+  while (similar.size() < 120) {
+    similar.push_back(Edit(similar[random() % similar.size()], 1 + random() % 4, random));
+  }
+  TestDexs similar_dexs({.classes_per_dex = 8, .methods_per_class = 8, .strings = similar});
+  for (bool no_cache : {false, true}) {
+    DexHelper helper(similar_dexs.dexs(), 1, {}, false, no_cache);
+    TestSimilar(similar_dexs, helper, random);
+  }
+  if (failures) {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,615 @@
+#include <map>
+#include <set>
+
+#include "dex_helper_testing.h"
+
+// Checks DexHelper queries on generated dexs against a plain pass over what the generator
+// recorded, and the indexed and filtered queries against the plain ones they refine.
+
+using namespace dex_helper_testing;
+
+namespace {
+const std::vector<size_t> kAny;
+
+// the method filters of the queries, by descriptor
+struct Filter {
+  std::string return_type;
+  short parameter_count = -1;
+  std::string shorty;
+  std::string declaring_class;
+  std::vector<std::string> parameter_types;
+  std::vector<std::string> contains_parameter_types;
+
+  bool Matches(const TestMethod &method) const {
+    if (!return_type.empty() && method.return_type != return_type) return false;
+    if (parameter_count != -1 && method.parameters.size() != size_t(parameter_count)) return false;
+    if (!shorty.empty() && method.shorty != shorty) return false;
+    if (!declaring_class.empty() && method.class_name != declaring_class) return false;
+    if (!parameter_types.empty() && method.parameters != parameter_types) return false;
+    for (const auto &type : contains_parameter_types) {
+      if (std::find(method.parameters.begin(), method.parameters.end(), type) ==
+          method.parameters.end()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::string Name() const {
+    std::string name = "filter";
+    if (!return_type.empty()) name += " return " + return_type;
+    if (parameter_count != -1) name += " count " + std::to_string(parameter_count);
+    if (!shorty.empty()) name += " shorty " + shorty;
+    if (!declaring_class.empty()) name += " class " + declaring_class;
+    if (!parameter_types.empty()) {
+      name += " parameters";
+      for (const auto &type : parameter_types) name += " " + type;
+    }
+    if (!contains_parameter_types.empty()) {
+      name += " contains";
+      for (const auto &type : contains_parameter_types) name += " " + type;
+    }
+    return name;
+  }
+};
+
+size_t ClassIndex(const DexHelper &helper, const std::string &type) {
+  return type.empty() ? size_t(-1) : helper.CreateClassIndex(type);
+}
+
+std::vector<size_t> ClassIndices(const DexHelper &helper, const std::vector<std::string> &types) {
+  std::vector<size_t> out;
+  for (const auto &type : types) out.push_back(helper.CreateClassIndex(type));
+  return out;
+}
+
+// filters covering each kind on its own and some together
+std::vector<Filter> MakeFilters(const TestDexs &dexs) {
+  std::vector<Filter> filters = {{}};
+  std::set<std::string> return_types;
+  std::set<std::string> shorties;
+  for (const auto &method : dexs.methods) {
+    return_types.insert(method.return_type);
+    shorties.insert(method.shorty);
+  }
+  for (const auto &type : return_types) filters.push_back({.return_type = type});
+  for (const auto &shorty : shorties) filters.push_back({.shorty = shorty});
+  for (short count = 0; count < 4; ++count) filters.push_back({.parameter_count = count});
+  for (const auto &type : {"I", "J", "Ljava/lang/String;", "[I"}) {
+    filters.push_back({.contains_parameter_types = {type}});
+  }
+  filters.push_back({.contains_parameter_types = {"I", "Ljava/lang/Object;"}});
+  for (size_t i = 0; i < dexs.methods.size(); i += 5) {
+    const auto &method = dexs.methods[i];
+    filters.push_back({.parameter_types = method.parameters});
+    filters.push_back({.return_type = method.return_type, .shorty = method.shorty});
+    filters.push_back({.declaring_class = method.class_name});
+    if (!method.parameters.empty()) {
+      filters.push_back({.return_type = method.return_type,
+                         .parameter_count = short(method.parameters.size()),
+                         .contains_parameter_types = {method.parameters.back()}});
+    }
+  }
+  return filters;
+}
+
+// the methods with an id in dex: those it defines and those its code calls
+std::vector<const TestMethod *> MethodsIn(const TestDexs &dexs, size_t dex) {
+  std::set<std::string> referenced;
+  for (const auto &method : dexs.methods) {
+    if (method.dex == dex) {
+      referenced.insert(method.Signature());
+      referenced.insert(method.callees.begin(), method.callees.end());
+    }
+  }
+  std::vector<const TestMethod *> out;
+  for (const auto &signature : referenced) out.push_back(dexs.FindMethod(signature));
+  return out;
+}
+
+void TestSignature(const TestDexs &dexs, const DexHelper &helper) {
+  for (auto filter : MakeFilters(dexs)) {
+    // the query filters by signature only
+    filter = {.return_type = filter.return_type,
+              .shorty = filter.shorty,
+              .parameter_types = filter.parameter_types};
+    if (filter.parameter_types.empty() && filter.return_type.empty() && filter.shorty.empty()) {
+      continue;
+    }
+    std::vector<const TestMethod *> expected;
+    for (size_t dex = 0; dex < dexs.dexs().size(); ++dex) {
+      for (const auto *method : MethodsIn(dexs, dex)) {
+        if (filter.Matches(*method)) expected.push_back(method);
+      }
+    }
+    ExpectEqual("signature " + filter.Name(), Signatures(expected),
+                Signatures(helper, helper.FindMethodBySignature(
+                                       ClassIndex(helper, filter.return_type),
+                                       ClassIndices(helper, filter.parameter_types), filter.shorty,
+                                       kAny, false)));
+  }
+}
+
+// each filter on FindMethodUsingString picks its matches out of the unfiltered result
+void TestStringFilters(const TestDexs &dexs, const DexHelper &helper) {
+  for (const auto &str : dexs.strings) {
+    for (bool prefix : {false, true}) {
+      std::vector<const TestMethod *> users;
+      for (const auto &method : dexs.methods) {
+        for (const auto &used : method.strings) {
+          if (prefix ? used.starts_with(str) : used == str) users.push_back(&method);
+        }
+      }
+      auto unfiltered = helper.FindMethodUsingString(str, prefix, -1, -1, "", -1, kAny, kAny, kAny,
+                                                     false);
+      auto name = "string \"" + str + "\"" + (prefix ? " prefix" : "");
+      ExpectEqual(name, Signatures(users), Signatures(helper, unfiltered));
+      for (const auto &filter : MakeFilters(dexs)) {
+        std::vector<const TestMethod *> expected;
+        for (const auto *method : users) {
+          if (filter.Matches(*method)) expected.push_back(method);
+        }
+        auto found = helper.FindMethodUsingString(
+            str, prefix, ClassIndex(helper, filter.return_type), filter.parameter_count,
+            filter.shorty, ClassIndex(helper, filter.declaring_class),
+            ClassIndices(helper, filter.parameter_types),
+            ClassIndices(helper, filter.contains_parameter_types), kAny, false);
+        ExpectEqual(name + " " + filter.Name(), Signatures(expected), Signatures(helper, found));
+        auto first = helper.FindMethodUsingString(
+            str, prefix, ClassIndex(helper, filter.return_type), filter.parameter_count,
+            filter.shorty, ClassIndex(helper, filter.declaring_class),
+            ClassIndices(helper, filter.parameter_types),
+            ClassIndices(helper, filter.contains_parameter_types), kAny, true);
+        Expect(name + " " + filter.Name() + " find_first",
+               expected.empty() ? first.empty()
+                                : first.size() == 1 && std::find(found.begin(), found.end(),
+                                                                 first[0]) != found.end());
+      }
+    }
+  }
+}
+
+// no_cache reads the code each query needs, and so must find what the caches would, while
+// the helper keeps its construction footprint
+void TestNoCache(const TestDexs &dexs) {
+  const auto queries = MakeQueries(dexs);
+  DexHelper cached(dexs.dexs());
+  DexHelper uncached(dexs.dexs(), 1, {}, false, true);
+  const auto footprint = uncached.GetCacheMemoryUsage();
+  for (const auto &[name, query] : queries) {
+    ExpectEqual("no_cache " + name, query(cached), query(uncached));
+  }
+  for (const auto &str : dexs.strings) {
+    auto all = uncached.FindMethodUsingString(str, false, -1, -1, "", -1, kAny, kAny, kAny, false);
+    auto first = uncached.FindMethodUsingString(str, false, -1, -1, "", -1, kAny, kAny, kAny, true);
+    Expect("no_cache find_first \"" + str + "\"",
+           all.empty() ? first.empty()
+                       : first.size() == 1 &&
+                             std::find(all.begin(), all.end(), first[0]) != all.end());
+  }
+  Expect("no_cache footprint", uncached.GetCacheMemoryUsage() == footprint);
+
+  // what a cached query finds in between is used, and the rest still read directly
+  cached.CreateFullCache();
+  DexHelper mixed(dexs.dexs(), 1, {}, false, true);
+  for (size_t i = 0; i < queries.size(); ++i) {
+    if (i == queries.size() / 2) mixed.CreateFullCache();
+    ExpectEqual("no_cache after CreateFullCache " + queries[i].first, queries[i].second(cached),
+                queries[i].second(mixed));
+  }
+}
+
+void TestTypeUsage(const TestDexs &dexs, const DexHelper &helper) {
+  const auto filters = MakeFilters(dexs);
+  std::vector<std::string> types = dexs.types;
+  for (const auto &type : dexs.types) types.push_back("[" + type);
+  for (const auto &type : types) {
+    if (helper.CreateClassIndex(type) == size_t(-1)) continue;
+    // every kind alone, two together and all of them
+    std::vector<unsigned> masks = {(1u << DexHelper::kNewInstance) | (1u << DexHelper::kCheckCast),
+                                   ~0u};
+    for (unsigned kind = 0; kind < DexHelper::kTypeUsageCount; ++kind) masks.push_back(1u << kind);
+    for (auto kinds : masks) {
+      for (size_t f = 0; f < filters.size(); f += 7) {
+        const auto &filter = filters[f];
+        std::vector<const TestMethod *> expected;
+        for (unsigned kind = 0; kind < DexHelper::kTypeUsageCount; ++kind) {
+          if (!(kinds & (1u << kind))) continue;
+          for (const auto &method : dexs.methods) {
+            if (!filter.Matches(method)) continue;
+            if (std::find(method.types.begin(), method.types.end(), std::pair(kind, type)) !=
+                method.types.end()) {
+              expected.push_back(&method);
+            }
+          }
+        }
+        auto found = helper.FindMethodUsingType(
+            helper.CreateClassIndex(type), kinds, ClassIndex(helper, filter.return_type),
+            filter.parameter_count, filter.shorty, ClassIndex(helper, filter.declaring_class),
+            ClassIndices(helper, filter.parameter_types),
+            ClassIndices(helper, filter.contains_parameter_types), kAny, false);
+        auto name = "type " + type + " kinds " + std::to_string(kinds) + " " + filter.Name();
+        ExpectEqual(name, Signatures(expected), Signatures(helper, found));
+        auto first = helper.FindMethodUsingType(
+            helper.CreateClassIndex(type), kinds, ClassIndex(helper, filter.return_type),
+            filter.parameter_count, filter.shorty, ClassIndex(helper, filter.declaring_class),
+            ClassIndices(helper, filter.parameter_types),
+            ClassIndices(helper, filter.contains_parameter_types), kAny, true);
+        Expect(name + " find_first",
+               expected.empty() ? first.empty()
+                                : first.size() == 1 && std::find(found.begin(), found.end(),
+                                                                 first[0]) != found.end());
+      }
+    }
+  }
+}
+
+// FindMethodUsingNumberRange scans the literals until Compact sorts them, then searches them
+void TestNumberUsage(const TestDexs &dexs, const DexHelper &helper) {
+  auto expect_range = [&](int64_t lower, int64_t upper, const std::string &stage) {
+    std::vector<const TestMethod *> expected;
+    for (const auto &method : dexs.methods) {
+      for (auto number : method.numbers) {
+        if (lower <= number && number <= upper) expected.push_back(&method);
+      }
+    }
+    auto name = stage + " numbers " + std::to_string(lower) + ".." + std::to_string(upper);
+    auto found = helper.FindMethodUsingNumberRange(lower, upper, -1, -1, "", -1, kAny, kAny, kAny,
+                                                   false);
+    ExpectEqual(name, Signatures(expected), Signatures(helper, found));
+    if (lower == upper) {
+      ExpectEqual(name + " exact", Signatures(expected),
+                  Signatures(helper, helper.FindMethodUsingNumber(lower, -1, -1, "", -1, kAny, kAny,
+                                                                  kAny, false)));
+    }
+    auto first = helper.FindMethodUsingNumberRange(lower, upper, -1, -1, "", -1, kAny, kAny, kAny,
+                                                   true);
+    Expect(name + " find_first",
+           expected.empty() ? first.empty()
+                            : first.size() == 1 &&
+                                  std::find(found.begin(), found.end(), first[0]) != found.end());
+  };
+  for (const auto *stage : {"scanned", "compacted"}) {
+    for (auto number : dexs.numbers) expect_range(number, number, stage);
+    expect_range(3, 3, stage);
+    expect_range(-2, 7, stage);
+    expect_range(8, 65536, stage);
+    expect_range(INT64_MIN, -1, stage);
+    expect_range(INT64_MIN, INT64_MAX, stage);
+    expect_range(7, 1, stage);
+    helper.CreateFullCache();
+    helper.Compact();
+  }
+}
+
+// the types below start by breadth first search over the generated hierarchy, with the depth
+// each is first reached at
+std::map<std::string, size_t> Subtypes(const TestDexs &dexs, const std::string &start,
+                                       bool implementations, bool transitive) {
+  std::map<std::string, size_t> depths{{start, 0}};
+  std::vector<std::string> queue{start};
+  for (size_t next = 0; next < queue.size(); ++next) {
+    auto depth = depths[queue[next]];
+    if (depth > 0 && !transitive) break;
+    for (const auto &clazz : dexs.classes) {
+      bool below = clazz.superclass == queue[next] ||
+                   (implementations && std::find(clazz.interfaces.begin(), clazz.interfaces.end(),
+                                                 queue[next]) != clazz.interfaces.end());
+      if (below && depths.emplace(clazz.name, depth + 1).second) queue.push_back(clazz.name);
+    }
+  }
+  depths.erase(start);
+  return depths;
+}
+
+std::vector<std::string> ClassNames(const DexHelper &helper, const std::vector<size_t> &classes) {
+  std::vector<std::string> out;
+  for (auto class_idx : classes) out.emplace_back(helper.DecodeClass(class_idx).name);
+  return out;
+}
+
+// FindSubclasses, FindImplementations and FindSuperclasses against the generated hierarchy,
+// across dexs, nearer types first
+void TestHierarchy(const TestDexs &dexs, const DexHelper &helper) {
+  const auto footprint = helper.GetCacheMemoryUsage();
+  auto expect_subtypes = [&](const std::string &name, const std::map<std::string, size_t> &expected,
+                             const std::vector<size_t> &found) {
+    auto names = ClassNames(helper, found);
+    std::vector<std::string> sorted = names;
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<std::string> expected_names;
+    for (const auto &[type, depth] : expected) expected_names.push_back(type);
+    ExpectEqual(name, expected_names, sorted);
+    size_t last = 0;
+    for (const auto &type : names) {
+      auto depth = expected.contains(type) ? expected.at(type) : 0;
+      Expect(name + " order", depth >= last);
+      last = depth;
+    }
+  };
+  std::vector<std::string> types{"Ljava/lang/Object;"};
+  for (const auto &clazz : dexs.classes) types.push_back(clazz.name);
+  for (const auto &type : types) {
+    auto class_idx = helper.CreateClassIndex(type);
+    for (bool transitive : {false, true}) {
+      expect_subtypes("subclasses " + type + (transitive ? " transitive" : ""),
+                      Subtypes(dexs, type, false, transitive),
+                      helper.FindSubclasses(class_idx, transitive));
+    }
+    expect_subtypes("implementations " + type, Subtypes(dexs, type, true, true),
+                    helper.FindImplementations(class_idx));
+
+    std::vector<std::string> superclasses;
+    for (const auto *clazz = dexs.FindClass(type); clazz;
+         clazz = dexs.FindClass(clazz->superclass)) {
+      superclasses.push_back(clazz->superclass);
+    }
+    // nearest first, so not sorted
+    ExpectEqual("superclasses " + type, superclasses,
+                ClassNames(helper, helper.FindSuperclasses(class_idx)));
+  }
+  Expect("subclasses of no class", helper.FindSubclasses(size_t(-1), true).empty());
+  Expect("superclasses of no class", helper.FindSuperclasses(size_t(-1)).empty());
+  Expect("hierarchy footprint", helper.GetCacheMemoryUsage() > footprint);
+}
+// the callers that may dispatch to method: calls naming it on its class, the subtypes
+// inheriting it and, for a virtual method, on every type above those, each caller once
+std::vector<std::string> DispatchCallers(const TestDexs &dexs, const TestMethod &method) {
+  auto same = [&](const TestMethod &other) {
+    return other.name == method.name && other.parameters == method.parameters &&
+           other.return_type == method.return_type;
+  };
+  auto declares = [&](const std::string &type) {
+    return std::any_of(dexs.methods.begin(), dexs.methods.end(), [&](const TestMethod &other) {
+      return other.class_name == type && same(other);
+    });
+  };
+  std::set<std::string> found{method.class_name};
+  std::vector<std::string> types{method.class_name};
+  for (size_t next = 0; next < types.size(); ++next) {
+    for (const auto &clazz : dexs.classes) {
+      bool below = clazz.superclass == types[next] ||
+                   (method.is_virtual &&
+                    std::find(clazz.interfaces.begin(), clazz.interfaces.end(), types[next]) !=
+                        clazz.interfaces.end());
+      // an override or a hiding method is what calls naming it reach
+      if (below && found.insert(clazz.name).second && !declares(clazz.name)) {
+        types.push_back(clazz.name);
+      }
+    }
+  }
+  if (method.is_virtual) {
+    for (const auto *clazz = dexs.FindClass(method.class_name); clazz;
+         clazz = dexs.FindClass(clazz->superclass)) {
+      if (found.insert(clazz->superclass).second) types.push_back(clazz->superclass);
+    }
+    for (size_t next = 0; next < types.size(); ++next) {
+      const auto *clazz = dexs.FindClass(types[next]);
+      if (!clazz) continue;
+      for (const auto &interface : clazz->interfaces) {
+        if (found.insert(interface).second) types.push_back(interface);
+      }
+    }
+  }
+  std::vector<std::string> out;
+  for (const auto &caller : dexs.methods) {
+    bool calls = std::any_of(caller.callees.begin(), caller.callees.end(), [&](const auto &sig) {
+      const auto *callee = dexs.FindMethod(sig);
+      return same(*callee) &&
+             std::find(types.begin(), types.end(), callee->class_name) != types.end();
+    });
+    if (calls) out.push_back(caller.Signature());
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+// FindMethodInvokedByDispatch against the generated hierarchy and calls, for static methods,
+// which only their own class dispatches to, and virtual ones, overridden here and there
+void TestDispatch(const TestDexs &dexs, const DexHelper &helper) {
+  size_t dispatched = 0;
+  for (const auto &method : dexs.methods) {
+    auto name = "dispatch " + method.Signature();
+    auto method_idx = MethodIndex(helper, method);
+    auto found = helper.FindMethodInvokedByDispatch(method_idx, -1, -1, "", -1, kAny, kAny, kAny,
+                                                    false);
+    auto expected = DispatchCallers(dexs, method);
+    ExpectEqual(name, expected, Signatures(helper, found));
+    // calls naming the method itself are among them, listed once
+    auto direct = Signatures(helper, helper.FindMethodInvoked(method_idx, -1, -1, "", -1, kAny,
+                                                              kAny, kAny, false));
+    direct.erase(std::unique(direct.begin(), direct.end()), direct.end());
+    Expect(name + " direct calls",
+           std::includes(expected.begin(), expected.end(), direct.begin(), direct.end()));
+    dispatched += expected.size() > direct.size();
+    auto first = helper.FindMethodInvokedByDispatch(method_idx, -1, -1, "", -1, kAny, kAny, kAny,
+                                                    true);
+    Expect(name + " find_first",
+           found.empty() ? first.empty()
+                         : first.size() == 1 &&
+                               std::find(found.begin(), found.end(), first[0]) != found.end());
+  }
+  // the generated calls should reach some methods through other types
+  Expect("dispatched calls", dispatched > 0);
+  Expect("dispatch to no method",
+         helper.FindMethodInvokedByDispatch(size_t(-1), -1, -1, "", -1, kAny, kAny, kAny, false)
+             .empty());
+}
+
+// the depth of every method max_depth calls from start, following callees or callers, by a
+// breadth-first search over the recorded calls
+std::map<std::string, size_t> Transitive(const TestDexs &dexs, const std::string &start,
+                                         bool callers, size_t max_depth) {
+  std::map<std::string, std::vector<std::string>> edges;
+  for (const auto &method : dexs.methods) {
+    for (const auto &callee : method.callees) {
+      if (callers) {
+        edges[callee].push_back(method.Signature());
+      } else {
+        edges[method.Signature()].push_back(callee);
+      }
+    }
+  }
+  std::map<std::string, size_t> depths;
+  std::vector<std::string> frontier = {start};
+  for (size_t depth = 1; depth <= max_depth && !frontier.empty(); ++depth) {
+    std::vector<std::string> next;
+    for (const auto &signature : frontier) {
+      for (const auto &neighbor : edges[signature]) {
+        if (neighbor == start || !depths.emplace(neighbor, depth).second) continue;
+        next.push_back(neighbor);
+      }
+    }
+    frontier = std::move(next);
+  }
+  return depths;
+}
+
+// FindReachableMethods and FindCallersTransitive against the recorded calls, at each depth
+// and on more workers, nearest first and each method once
+void TestTransitive(const TestDexs &dexs, const DexHelper &helper) {
+  std::vector<const TestMethod *> starts;
+  for (size_t i = 0; i < dexs.methods.size(); i += 3) starts.push_back(&dexs.methods[i]);
+  for (const auto &ref : dexs.refs) starts.push_back(&ref);
+  const std::vector<Filter> filters = {{}, {.return_type = "V"}};
+  size_t deep = 0;
+  for (const auto *start : starts) {
+    auto method_idx = MethodIndex(helper, *start);
+    for (bool callers : {false, true}) {
+      auto search = [&](size_t max_depth, const Filter &filter, bool find_first, size_t threads) {
+        auto return_type = filter.return_type.empty()
+                               ? size_t(-1)
+                               : helper.CreateClassIndex(filter.return_type);
+        return callers ? helper.FindCallersTransitive(method_idx, max_depth, return_type, -1, "",
+                                                      -1, kAny, kAny, kAny, find_first, threads)
+                       : helper.FindReachableMethods(method_idx, max_depth, return_type, -1, "",
+                                                     -1, kAny, kAny, kAny, find_first, threads);
+      };
+      // the order of searching each method of a level alone, with the helper's own order of a
+      // method's callers or callees
+      std::vector<size_t> serial;
+      std::set<size_t> visited = {method_idx};
+      std::vector<size_t> frontier = {method_idx};
+      while (!frontier.empty()) {
+        std::vector<size_t> next;
+        for (auto index : frontier) {
+          auto neighbors =
+              callers ? helper.FindMethodInvoked(index, -1, -1, "", -1, kAny, kAny, kAny, false)
+                      : helper.FindMethodInvoking(index, -1, -1, "", -1, kAny, kAny, kAny, false);
+          for (auto neighbor : neighbors) {
+            if (visited.insert(neighbor).second) next.push_back(neighbor);
+          }
+        }
+        serial.insert(serial.end(), next.begin(), next.end());
+        frontier = std::move(next);
+      }
+      for (size_t threads : {1zu, 4zu}) {
+        Expect((callers ? "callers of " : "reachable from ") + start->Signature() + " order",
+               search(size_t(-1), {}, false, threads) == serial);
+      }
+      for (size_t max_depth : {0zu, 1zu, 2zu, 3zu, size_t(-1)}) {
+        auto depths = Transitive(dexs, start->Signature(), callers, max_depth);
+        for (const auto &[signature, depth] : depths) deep += depth > 1;
+        for (size_t f = 0; f < filters.size(); ++f) {
+          auto name = (callers ? "callers of " : "reachable from ") + start->Signature() +
+                      " within " + std::to_string(max_depth) + " filter " + std::to_string(f);
+          std::vector<std::string> expected;
+          size_t nearest = size_t(-1);
+          for (const auto &[signature, depth] : depths) {
+            if (!filters[f].Matches(*dexs.FindMethod(signature))) continue;
+            expected.push_back(signature);
+            nearest = std::min(nearest, depth);
+          }
+          for (size_t threads : {1zu, 4zu}) {
+            auto found = search(max_depth, filters[f], false, threads);
+            ExpectEqual(name + " threads " + std::to_string(threads), expected,
+                        Signatures(helper, found));
+            size_t last = 0;
+            for (auto method : found) {
+              auto depth = depths[Signatures(helper, {method})[0]];
+              Expect(name + " order", depth >= last);
+              last = depth;
+            }
+          }
+          // the one found first is one of the nearest
+          auto first = search(max_depth, filters[f], true, 1);
+          Expect(name + " find_first",
+                 expected.empty()
+                     ? first.empty()
+                     : first.size() == 1 && depths[Signatures(helper, first)[0]] == nearest);
+        }
+      }
+    }
+  }
+  // the generated calls should chain
+  Expect("transitive calls", deep > 0);
+  Expect("reachable from no method",
+         helper.FindReachableMethods(size_t(-1), -1, -1, -1, "", -1, kAny, kAny, kAny, false)
+             .empty());
+  Expect("callers of no method",
+         helper.FindCallersTransitive(size_t(-1), -1, -1, -1, "", -1, kAny, kAny, kAny, false)
+             .empty());
+}
+
+// overloads share a name, the parameters pick one, the same with or without global indices
+void TestOverloads(const TestDexs &dexs) {
+  size_t overloads = 0;
+  for (const auto &method : dexs.methods) {
+    for (const auto &other : dexs.methods) {
+      overloads += &other != &method && other.class_name == method.class_name &&
+                   other.name == method.name;
+    }
+  }
+  Expect("overloads", overloads > 0);
+  for (bool global : {false, true}) {
+    DexHelper helper(dexs.dexs(), 1, {}, true);
+    if (global) helper.CreateGlobalIndices();
+    for (const auto &method : dexs.methods) {
+      ExpectEqual("overload " + method.Signature() + (global ? " global" : ""),
+                  {method.Signature()}, Signatures(helper, {MethodIndex(helper, method)}));
+    }
+  }
+}
+
+// a subtype may be in any dex, so a lazy helper builds them all, even for callers in one
+void TestLazyDispatch(const TestDexs &dexs) {
+  DexHelper lazy(dexs.dexs(), 1, {}, true);
+  const auto &method = dexs.methods.front();
+  const std::vector<size_t> priority = {method.dex};
+  lazy.FindMethodInvoked(MethodIndex(lazy, method), -1, -1, "", -1, kAny, kAny, priority, false);
+  auto built = [&] {
+    return std::count_if(lazy.GetBuildTimes().begin(), lazy.GetBuildTimes().end(),
+                         [](double time) { return time > 0; });
+  };
+  Expect("direct callers build one dex", built() == 1);
+  lazy.FindMethodInvokedByDispatch(MethodIndex(lazy, method), -1, -1, "", -1, kAny, kAny,
+                                   priority, false);
+  Expect("dispatch builds every dex", size_t(built()) == lazy.GetBuildTimes().size());
+}
+}  // namespace
+
+int main() {
+  TestDexs dexs;
+  for (bool lazy : {false, true}) {
+    DexHelper helper(dexs.dexs(), 1, {}, lazy);
+    TestSignature(dexs, helper);
+    TestStringFilters(dexs, helper);
+    TestTypeUsage(dexs, helper);
+    TestNumberUsage(dexs, helper);
+    TestHierarchy(dexs, helper);
+    TestDispatch(dexs, helper);
+    TestTransitive(dexs, helper);
+  }
+  TestNoCache(dexs);
+  TestOverloads(dexs);
+  TestLazyDispatch(dexs);
+  {
+    DexHelper helper(dexs.dexs(), 1, {}, false, true);
+    TestTransitive(dexs, helper);
+  }
+  if (failures) {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  return 0;
+}
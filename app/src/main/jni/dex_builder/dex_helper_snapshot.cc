@@ -0,0 +1,344 @@
+#include "dex_helper.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "slicer/dex_format.h"
+
+// Snapshot layout, every field and section is a 4-byte aligned array of u4, except for
+// the string keys which are an 8-byte aligned array of u8 and the method columns of u2,
+// which are padded to 4 bytes, and the number cache:
+//   SnapshotHeader
+//   SnapshotDex[dex_count]
+//   sections, each referenced by file offset from its SnapshotDex.
+// Posting list sections hold (size + 1) offsets immediately followed by the values.
+// The number cache is 8-byte aligned, its size and a u4 of padding, then the literals as s8
+// sorted by value, then their method ids as u4.
+// The symbol sections hold the global index of every type, method and field id as u4, or are
+// all 0 if the indices were not built when the snapshot was saved.
+namespace {
+constexpr char kSnapshotMagic[4] = {'d', 'h', 's', 'n'};
+constexpr dex::u4 kSnapshotVersion = 9;
+
+enum SnapshotSection : dex::u4 {
+    kStrings,
+    kStringKeys,
+    kMethodCodes,
+    kMethodClassIds,
+    kMethodReturnTypes,
+    kMethodParameterCounts,
+    kMethodFirstParameters,
+    kMethodShorties,
+    kClassCache,
+    kDeclaringCache,
+    kStringCache,
+    kInvokingCache,
+    kInvokedCache,
+    kGettingCache,
+    kSettingCache,
+    kTypeCache,
+    kNumberCache,
+    kShortyCache,
+    kParameterCache,
+    kProtoCache,
+    kClassSymbols,
+    kMethodSymbols,
+    kFieldSymbols,
+    kSectionCount,
+};
+
+struct SnapshotHeader {
+    char magic[4];
+    dex::u4 version;
+    dex::u4 dex_count;
+    dex::u4 file_size;
+};
+
+struct SnapshotDex {
+    dex::u4 checksum;
+    dex::u1 signature[dex::kSHA1DigestLen];
+    dex::u4 sections[kSectionCount];
+};
+
+static_assert(sizeof(SnapshotHeader) % 4 == 0);
+static_assert(sizeof(SnapshotDex) % 4 == 0);
+}  // namespace
+
+DexHelper::~DexHelper() {
+    CancelWarmup();
+    if (snapshot_) {
+        munmap(const_cast<void *>(snapshot_), snapshot_size_);
+    }
+}
+
+bool DexHelper::SaveSnapshot(std::string_view snapshot_path) const {
+    CreateFullCache();
+    // the global indices are only saved if something already built them, they take a pass over
+    // every symbol that a later launch may never need
+    const bool save_symbols = global_indices_ready_.load(std::memory_order_acquire);
+
+    std::string path(snapshot_path);
+    std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    dex::u4 pos = 0;
+    auto write = [&out, &pos](const void *data, size_t size) {
+        out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        pos += size;
+    };
+    auto write_lists = [&write, &pos](const PostingLists &lists) {
+        auto offset = pos;
+        dex::u4 value_count = 0;
+        for (auto key = 0zu; key < lists.size(); ++key) {
+            write(&value_count, sizeof(value_count));
+            value_count += lists[key].size();
+        }
+        write(&value_count, sizeof(value_count));
+        for (auto key = 0zu; key < lists.size(); ++key) {
+            write(lists[key].data(), lists[key].size_bytes());
+        }
+        return offset;
+    };
+
+    std::vector<SnapshotDex> dexs(readers_.size());
+    SnapshotHeader header{};
+    memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.dex_count = readers_.size();
+    write(&header, sizeof(header));
+    write(dexs.data(), dexs.size() * sizeof(SnapshotDex));
+
+    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+        std::shared_lock lock(dex_locks_[dex_idx]);
+        const auto *dex_header = readers_[dex_idx].Header();
+        auto &sections = dexs[dex_idx].sections;
+        dexs[dex_idx].checksum = dex_header->checksum;
+        memcpy(dexs[dex_idx].signature, dex_header->signature, dex::kSHA1DigestLen);
+
+        const auto &strs = strings_[dex_idx].refs();
+        sections[kStrings] = pos;
+        write(strs.begin(), strs.size() * sizeof(StringRef));
+        if (pos % sizeof(uint64_t)) {
+            dex::u4 padding = 0;
+            write(&padding, sizeof(padding));
+        }
+        const auto &keys = strings_[dex_idx].keys();
+        sections[kStringKeys] = pos;
+        write(keys.begin(), keys.size() * sizeof(uint64_t));
+        sections[kMethodCodes] = pos;
+        write(method_codes_[dex_idx].begin(), method_codes_[dex_idx].size() * sizeof(uint32_t));
+        const auto &columns = method_columns_[dex_idx];
+        for (auto [section, column] : {std::pair(kMethodClassIds, &columns.class_ids),
+                                       std::pair(kMethodReturnTypes, &columns.return_types),
+                                       std::pair(kMethodParameterCounts, &columns.parameter_counts),
+                                       std::pair(kMethodFirstParameters, &columns.first_parameters)}) {
+            sections[section] = pos;
+            write(column->begin(), column->size() * sizeof(uint16_t));
+            if (pos % sizeof(uint32_t)) {
+                dex::u2 padding = 0;
+                write(&padding, sizeof(padding));
+            }
+        }
+        sections[kMethodShorties] = pos;
+        write(columns.shorties.begin(), columns.shorties.size() * sizeof(uint32_t));
+        sections[kClassCache] = pos;
+        write(class_cache_[dex_idx].begin(), class_cache_[dex_idx].size() * sizeof(uint32_t));
+        sections[kDeclaringCache] = write_lists(declaring_cache_[dex_idx]);
+        sections[kStringCache] = write_lists(string_cache_[dex_idx]);
+        sections[kInvokingCache] = write_lists(invoking_cache_[dex_idx]);
+        sections[kInvokedCache] = write_lists(invoked_cache_[dex_idx]);
+        sections[kGettingCache] = write_lists(getting_cache_[dex_idx]);
+        sections[kSettingCache] = write_lists(setting_cache_[dex_idx]);
+        sections[kTypeCache] = write_lists(type_cache_[dex_idx]);
+        if (pos % sizeof(uint64_t)) {
+            dex::u4 padding = 0;
+            write(&padding, sizeof(padding));
+        }
+        sections[kNumberCache] = pos;
+        const auto [number_values, number_methods] = number_cache_[dex_idx].Sorted();
+        const dex::u4 number_header[2] = {static_cast<dex::u4>(number_values.size()), 0};
+        write(number_header, sizeof(number_header));
+        write(number_values.data(), number_values.size() * sizeof(int64_t));
+        write(number_methods.data(), number_methods.size() * sizeof(uint32_t));
+        sections[kShortyCache] = write_lists(shorty_cache_[dex_idx]);
+        sections[kParameterCache] = write_lists(parameter_cache_[dex_idx]);
+        sections[kProtoCache] = write_lists(proto_cache_[dex_idx]);
+        for (auto [section, rev] : {std::pair(kClassSymbols, &rev_class_indices_),
+                                    std::pair(kMethodSymbols, &rev_method_indices_),
+                                    std::pair(kFieldSymbols, &rev_field_indices_)}) {
+            if (!save_symbols) continue;
+            std::vector<uint32_t> symbols((*rev)[dex_idx].begin(), (*rev)[dex_idx].end());
+            sections[section] = pos;
+            write(symbols.data(), symbols.size() * sizeof(uint32_t));
+        }
+    }
+
+    header.file_size = pos;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(dexs.data()),
+              static_cast<std::streamsize>(dexs.size() * sizeof(SnapshotDex)));
+    out.close();
+    if (!out) {
+        unlink(tmp_path.data());
+        return false;
+    }
+    return rename(tmp_path.data(), path.data()) == 0;
+}
+
+bool DexHelper::LoadSnapshot(std::string_view snapshot_path) {
+    std::string path(snapshot_path);
+    int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat s {};
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &s) == 0 && static_cast<size_t>(s.st_size) >= sizeof(SnapshotHeader)) {
+        addr = mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+
+    const auto *begin = static_cast<const dex::u1 *>(addr);
+    const size_t size = s.st_size;
+    const auto *header = reinterpret_cast<const SnapshotHeader *>(begin);
+    const auto *dexs = reinterpret_cast<const SnapshotDex *>(header + 1);
+
+    // only the bounds needed to never read past the mapping are checked here,
+    // the content itself is trusted once every dex checksum and signature match
+    auto in_bounds = [size](size_t offset, size_t bytes) {
+        return offset % 4 == 0 && offset <= size && bytes <= size - offset;
+    };
+    auto valid_lists = [begin, &in_bounds](dex::u4 offset, size_t count) {
+        if (!in_bounds(offset, (count + 1) * sizeof(uint32_t))) return false;
+        const auto *offsets = reinterpret_cast<const uint32_t *>(begin + offset);
+        return offsets[0] == 0 &&
+               in_bounds(offset + (count + 1) * sizeof(uint32_t), offsets[count] * sizeof(uint32_t));
+    };
+
+    auto valid_numbers = [begin, &in_bounds](dex::u4 offset) {
+        if (offset % sizeof(uint64_t) || !in_bounds(offset, 2 * sizeof(uint32_t))) return false;
+        size_t count = *reinterpret_cast<const uint32_t *>(begin + offset);
+        return in_bounds(offset + 2 * sizeof(uint32_t), count * (sizeof(int64_t) + sizeof(uint32_t)));
+    };
+
+    // the symbol sections of every dex are either saved or all 0
+    const bool has_symbols = size >= sizeof(SnapshotHeader) + sizeof(SnapshotDex) &&
+                             dexs[0].sections[kClassSymbols] != 0;
+    auto valid_symbols = [&in_bounds, has_symbols](dex::u4 offset, size_t count) {
+        return has_symbols ? offset != 0 && in_bounds(offset, count * sizeof(uint32_t))
+                           : offset == 0;
+    };
+
+    bool valid = memcmp(header->magic, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0 &&
+                 header->version == kSnapshotVersion && header->dex_count == readers_.size() &&
+                 header->file_size == size &&
+                 in_bounds(sizeof(SnapshotHeader), readers_.size() * sizeof(SnapshotDex));
+    for (auto dex_idx = 0zu; valid && dex_idx < readers_.size(); ++dex_idx) {
+        const auto *dex_header = readers_[dex_idx].Header();
+        const auto &sections = dexs[dex_idx].sections;
+        valid = dexs[dex_idx].checksum == dex_header->checksum &&
+                memcmp(dexs[dex_idx].signature, dex_header->signature, dex::kSHA1DigestLen) == 0 &&
+                in_bounds(sections[kStrings], dex_header->string_ids_size * sizeof(StringRef)) &&
+                sections[kStringKeys] % sizeof(uint64_t) == 0 &&
+                in_bounds(sections[kStringKeys], dex_header->string_ids_size * sizeof(uint64_t)) &&
+                in_bounds(sections[kMethodCodes], dex_header->method_ids_size * sizeof(uint32_t)) &&
+                in_bounds(sections[kMethodClassIds], dex_header->method_ids_size * sizeof(uint16_t)) &&
+                in_bounds(sections[kMethodReturnTypes], dex_header->method_ids_size * sizeof(uint16_t)) &&
+                in_bounds(sections[kMethodParameterCounts], dex_header->method_ids_size * sizeof(uint16_t)) &&
+                in_bounds(sections[kMethodFirstParameters], dex_header->method_ids_size * sizeof(uint16_t)) &&
+                in_bounds(sections[kMethodShorties], dex_header->method_ids_size * sizeof(uint32_t)) &&
+                in_bounds(sections[kClassCache], dex_header->type_ids_size * sizeof(uint32_t)) &&
+                valid_lists(sections[kDeclaringCache], dex_header->type_ids_size) &&
+                valid_lists(sections[kStringCache], dex_header->string_ids_size) &&
+                valid_lists(sections[kInvokingCache], dex_header->method_ids_size) &&
+                valid_lists(sections[kInvokedCache], dex_header->method_ids_size) &&
+                valid_lists(sections[kGettingCache], dex_header->field_ids_size) &&
+                valid_lists(sections[kSettingCache], dex_header->field_ids_size) &&
+                valid_lists(sections[kTypeCache], dex_header->type_ids_size * kTypeUsageCount) &&
+                valid_numbers(sections[kNumberCache]) &&
+                valid_lists(sections[kShortyCache], dex_header->string_ids_size) &&
+                valid_lists(sections[kParameterCache], dex_header->type_ids_size) &&
+                valid_lists(sections[kProtoCache], dex_header->proto_ids_size) &&
+                valid_symbols(sections[kClassSymbols], dex_header->type_ids_size) &&
+                valid_symbols(sections[kMethodSymbols], dex_header->method_ids_size) &&
+                valid_symbols(sections[kFieldSymbols], dex_header->field_ids_size);
+    }
+    if (!valid) {
+        // stale (e.g. the app was updated) or corrupted, it will be rewritten on the next save
+        munmap(addr, size);
+        unlink(path.data());
+        return false;
+    }
+
+    for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+        const auto &dex = readers_[dex_idx];
+        const auto *dex_header = dex.Header();
+        const auto &sections = dexs[dex_idx].sections;
+        auto u4_at = [begin](dex::u4 offset) { return reinterpret_cast<const uint32_t *>(begin + offset); };
+        auto borrow_lists = [&u4_at](PostingLists &lists, dex::u4 offset, size_t count) {
+            lists.borrow(u4_at(offset), u4_at(offset) + count + 1, count);
+        };
+        strings_[dex_idx].borrow(reinterpret_cast<const char *>(dex.DataBegin()),
+                                 reinterpret_cast<const StringRef *>(begin + sections[kStrings]),
+                                 reinterpret_cast<const uint64_t *>(begin + sections[kStringKeys]),
+                                 dex_header->string_ids_size);
+        method_codes_[dex_idx].borrow(u4_at(sections[kMethodCodes]), dex_header->method_ids_size);
+        auto u2_at = [begin](dex::u4 offset) { return reinterpret_cast<const uint16_t *>(begin + offset); };
+        auto &columns = method_columns_[dex_idx];
+        columns.class_ids.borrow(u2_at(sections[kMethodClassIds]), dex_header->method_ids_size);
+        columns.return_types.borrow(u2_at(sections[kMethodReturnTypes]), dex_header->method_ids_size);
+        columns.parameter_counts.borrow(u2_at(sections[kMethodParameterCounts]), dex_header->method_ids_size);
+        columns.first_parameters.borrow(u2_at(sections[kMethodFirstParameters]), dex_header->method_ids_size);
+        columns.shorties.borrow(u4_at(sections[kMethodShorties]), dex_header->method_ids_size);
+        class_cache_[dex_idx].borrow(u4_at(sections[kClassCache]), dex_header->type_ids_size);
+        borrow_lists(declaring_cache_[dex_idx], sections[kDeclaringCache], dex_header->type_ids_size);
+        borrow_lists(string_cache_[dex_idx], sections[kStringCache], dex_header->string_ids_size);
+        borrow_lists(invoking_cache_[dex_idx], sections[kInvokingCache], dex_header->method_ids_size);
+        borrow_lists(invoked_cache_[dex_idx], sections[kInvokedCache], dex_header->method_ids_size);
+        borrow_lists(getting_cache_[dex_idx], sections[kGettingCache], dex_header->field_ids_size);
+        borrow_lists(setting_cache_[dex_idx], sections[kSettingCache], dex_header->field_ids_size);
+        borrow_lists(type_cache_[dex_idx], sections[kTypeCache], dex_header->type_ids_size * kTypeUsageCount);
+        const auto *number_values = reinterpret_cast<const int64_t *>(u4_at(sections[kNumberCache]) + 2);
+        const auto number_count = *u4_at(sections[kNumberCache]);
+        number_cache_[dex_idx].borrow(number_values,
+                                      reinterpret_cast<const uint32_t *>(number_values + number_count),
+                                      number_count);
+        borrow_lists(shorty_cache_[dex_idx], sections[kShortyCache], dex_header->string_ids_size);
+        borrow_lists(parameter_cache_[dex_idx], sections[kParameterCache], dex_header->type_ids_size);
+        borrow_lists(proto_cache_[dex_idx], sections[kProtoCache], dex_header->proto_ids_size);
+    }
+    // nothing has created an index yet, so the saved ones are restored as they were, if the
+    // snapshot has them
+    if (has_symbols) {
+        for (auto [section, indices, rev] :
+             {std::tuple(kClassSymbols, &class_indices_, &rev_class_indices_),
+              std::tuple(kMethodSymbols, &method_indices_, &rev_method_indices_),
+              std::tuple(kFieldSymbols, &field_indices_, &rev_field_indices_)}) {
+            std::vector<std::span<const uint32_t>> symbols;
+            size_t count = 0;
+            for (auto dex_idx = 0zu; dex_idx < readers_.size(); ++dex_idx) {
+                const auto *begin_symbols =
+                    reinterpret_cast<const uint32_t *>(begin + dexs[dex_idx].sections[section]);
+                symbols.emplace_back(begin_symbols, (*rev)[dex_idx].size());
+                for (auto index : symbols.back()) count = std::max(count, index + 1zu);
+                std::copy(symbols.back().begin(), symbols.back().end(), (*rev)[dex_idx].begin());
+            }
+            const auto [offsets, members] = GroupMembers(symbols, count);
+            for (auto index = 0zu; index < count; ++index) {
+                indices->push_back({members.begin() + offsets[index],
+                                    members.begin() + offsets[index + 1]});
+            }
+        }
+        global_indices_ready_.store(true, std::memory_order_release);
+    }
+    snapshot_ = addr;
+    snapshot_size_ = size;
+    return true;
+}
@@ -0,0 +1,92 @@
+#include <filesystem>
+
+#include "dex_helper_testing.h"
+
+// Saves snapshots of generated dexs, with and without the global indices, and checks that a
+// helper mapping one answers every query as the helper that saved it, and that stale or
+// corrupted snapshots are rejected.
+
+using namespace dex_helper_testing;
+
+namespace {
+std::vector<std::vector<std::string>> RunQueries(
+    const std::vector<std::pair<std::string, Query>> &queries, const DexHelper &helper) {
+  std::vector<std::vector<std::string>> out;
+  for (const auto &[name, query] : queries) out.push_back(query(helper));
+  return out;
+}
+
+void ExpectQueries(const std::string &what,
+                   const std::vector<std::pair<std::string, Query>> &queries,
+                   const std::vector<std::vector<std::string>> &expected, const DexHelper &helper) {
+  auto actual = RunQueries(queries, helper);
+  for (size_t i = 0; i < queries.size(); ++i) {
+    ExpectEqual(what + " " + queries[i].first, expected[i], actual[i]);
+  }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  const std::filesystem::path dir = argc > 1 ? argv[1] : ".";
+  TestDexs dexs;
+  auto queries = MakeQueries(dexs);
+
+  std::vector<uintmax_t> sizes;
+  for (bool global : {false, true}) {
+    const auto path = (dir / ("snapshot_test_" + std::to_string(global))).string();
+    const std::string name = global ? "global" : "on demand";
+    std::vector<std::vector<std::string>> expected;
+    std::vector<size_t> indices;
+    {
+      DexHelper helper(dexs.dexs());
+      if (global) helper.CreateGlobalIndices();
+      expected = RunQueries(queries, helper);
+      for (const auto &method : dexs.methods) indices.push_back(MethodIndex(helper, method));
+      Expect(name + " saved", helper.SaveSnapshot(path));
+    }
+    sizes.push_back(std::filesystem::file_size(path));
+
+    for (bool lazy : {false, true}) {
+      DexHelper helper(dexs.dexs(), 1, path, lazy);
+      Expect(name + " loaded", helper.IsSnapshotLoaded());
+      if (global) {
+        // the indices are restored as they were handed out
+        std::vector<size_t> loaded;
+        for (const auto &method : dexs.methods) loaded.push_back(MethodIndex(helper, method));
+        Expect(name + " indices", loaded == indices);
+      }
+      ExpectQueries(name + (lazy ? " lazy" : ""), queries, expected, helper);
+    }
+
+    // the dexs of another seed do not match it
+    TestDexs other({.seed = 2});
+    {
+      DexHelper helper(other.dexs(), 1, path);
+      Expect(name + " stale", !helper.IsSnapshotLoaded());
+    }
+    Expect(name + " stale removed", !std::filesystem::exists(path));
+  }
+  // without the indices, saving leaves out the symbol sections rather than building them
+  Expect("symbols only saved if built", sizes[0] < sizes[1]);
+
+  // a truncated snapshot is rejected, and the helper builds its tables instead
+  const auto path = (dir / "snapshot_test_truncated").string();
+  std::vector<std::vector<std::string>> expected;
+  {
+    DexHelper helper(dexs.dexs());
+    expected = RunQueries(queries, helper);
+    Expect("saved", helper.SaveSnapshot(path));
+  }
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+  {
+    DexHelper helper(dexs.dexs(), 1, path);
+    Expect("truncated", !helper.IsSnapshotLoaded());
+    ExpectQueries("truncated", queries, expected, helper);
+  }
+
+  if (failures) {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <atomic>
+#include <thread>
+
+#include "dex_helper_testing.h"
+
+// Runs the queries of many threads on one DexHelper, eager, lazy and with no_cache, while
+// another thread fully caches and compacts it, or, lazy, compacts and measures it while the
+// queries and a warmup are still building dexs, and checks every result against a serial run
+// on a fresh helper.
+
+using namespace dex_helper_testing;
+
+namespace {
+constexpr size_t kThreads = 8;
+constexpr size_t kRounds = 5;
+}  // namespace
+
+int main() {
+  TestDexs dexs;
+  auto queries = MakeQueries(dexs);
+
+  std::vector<std::vector<std::string>> expected;
+  {
+    DexHelper helper(dexs.dexs());
+    for (const auto &[name, query] : queries) expected.push_back(query(helper));
+  }
+
+  std::mt19937 random(1);
+  for (size_t round = 0; round < kRounds; ++round) {
+    bool lazy = round % 2 == 1 || round == 4;
+    bool no_cache = round == 2;
+    // the last round never caches everything, it compacts dexs as they get built
+    bool building = round == 4;
+    DexHelper helper(dexs.dexs(), round == 3 ? 2 : 1, {}, lazy, no_cache);
+    std::vector<std::vector<size_t>> orders(kThreads);
+    for (auto &order : orders) {
+      for (size_t i = 0; i < queries.size(); ++i) order.push_back(i);
+      std::shuffle(order.begin(), order.end(), random);
+    }
+    std::vector<std::vector<std::vector<std::string>>> results(
+        kThreads, std::vector<std::vector<std::string>>(queries.size()));
+    std::atomic_bool done = false;
+    std::thread compactor;
+    if (building) {
+      // compacts and measures over and over while the queries and the warmup build dexs
+      compactor = std::thread([&] {
+        while (!done.load()) {
+          helper.Compact();
+          helper.GetCacheMemoryUsage();
+        }
+      });
+      helper.StartWarmup();
+    }
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t] {
+        for (size_t i = 0; i < queries.size(); ++i) {
+          // one thread caches everything halfway through, under the others' queries
+          if (!building && t == 0 && i == queries.size() / 2) {
+            helper.CreateFullCache(2);
+            helper.Compact();
+          }
+          results[t][orders[t][i]] = queries[orders[t][i]].second(helper);
+        }
+      });
+    }
+    for (auto &thread : threads) thread.join();
+    done = true;
+    if (compactor.joinable()) compactor.join();
+    for (size_t t = 0; t < kThreads; ++t) {
+      for (size_t i = 0; i < queries.size(); ++i) {
+        ExpectEqual("round " + std::to_string(round) + " thread " + std::to_string(t) + " " +
+                        queries[i].first,
+                    expected[i], results[t][i]);
+      }
+    }
+  }
+
+  size_t empty = 0;
+  for (const auto &result : expected) empty += result.empty();
+  // the generated code should give most queries something to find
+  Expect("queries with results", empty * 2 < expected.size());
+  if (failures) {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  std::cout << queries.size() << " queries in " << kThreads << " threads agree" << std::endl;
+  return 0;
+}
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "dex_builder.h"
+#include "dex_helper.h"
+
+// Generated dexs for the DexHelper tests, with a record of what every method does, so
+// that queries can be checked against a plain pass over that record.
+
+namespace dex_helper_testing {
+
+using namespace startop::dex;
+
+struct TestField {
+  std::string class_name;
+  std::string name;
+  std::string type;
+};
+
+struct TestMethod {
+  std::string class_name;
+  std::string name;
+  std::string return_type;
+  std::vector<std::string> parameters;
+  std::string shorty;
+  size_t dex = 0;
+  // a virtual method, one of a few names that classes override, the others are static
+  bool is_virtual = false;
+  // what the code uses, in instruction order. callees are signatures, fields are indices
+  // into TestDexs::fields and types are (DexHelper::TypeUsage, descriptor)
+  std::vector<std::string> strings;
+  std::vector<std::string> callees;
+  std::vector<size_t> getting;
+  std::vector<size_t> setting;
+  std::vector<std::pair<unsigned, std::string>> types;
+  std::vector<int64_t> numbers;
+
+  std::string Signature() const {
+    std::string signature = class_name + "->" + name + "(";
+    for (const auto &parameter : parameters) signature += parameter;
+    return signature + ")" + return_type;
+  }
+};
+
+struct TestClass {
+  std::string name;
+  size_t dex = 0;
+  // an earlier class or java.lang.Object, and earlier classes, possibly of other dexs
+  std::string superclass = "Ljava/lang/Object;";
+  std::vector<std::string> interfaces;
+};
+
+struct TestOptions {
+  size_t dex_count = 3;
+  size_t classes_per_dex = 6;
+  size_t methods_per_class = 6;
+  // the strings methods load, a default pool if empty
+  std::vector<std::string> strings;
+  uint32_t seed = 1;
+};
+
+class TestDexs {
+public:
+  std::vector<TestClass> classes;
+  std::vector<TestField> fields;
+  std::vector<TestMethod> methods;
+  // the virtual methods code calls on classes that only inherit them, if at all
+  std::vector<TestMethod> refs;
+  std::vector<std::string> strings;
+  std::vector<std::string> types;
+  std::vector<int64_t> numbers;
+
+  explicit TestDexs(const TestOptions &options = {}) {
+    std::mt19937 random(options.seed);
+    auto pick = [&random](size_t count) {
+      return std::uniform_int_distribution<size_t>(0, count - 1)(random);
+    };
+    strings = options.strings;
+    if (strings.empty()) {
+      strings = {"", "a", "ab", "abc", "abcd", "hello", "hello world", "Hello, World",
+                 "version 1.2.3", "version 1.2.4", "user_name", "userName", "http://example.com/a",
+                 "error: %d", "\xc3\xa9t\xc3\xa9", "zzz"};
+    }
+    numbers = {0, 1, 7, 8, 100, 1000, 32767, 65536, 123456789, 2147483647, -1, -2, -40000};
+
+    for (size_t dex = 0; dex < options.dex_count; ++dex) {
+      for (size_t c = 0; c < options.classes_per_dex; ++c) {
+        classes.push_back({"Ltest/D" + std::to_string(dex) + "C" + std::to_string(c) + ";", dex});
+      }
+    }
+    types = {"Ljava/lang/Object;", "Ljava/lang/String;", "[I", "[Ljava/lang/String;"};
+    for (const auto &clazz : classes) types.push_back(clazz.name);
+    const std::vector<std::string> value_types = {"I", "J", "Z", "Ljava/lang/String;",
+                                                  "Ljava/lang/Object;", "[I", classes[0].name};
+    for (const auto &clazz : classes) {
+      for (size_t f = 0; f < 2; ++f) {
+        fields.push_back({clazz.name, "f" + std::to_string(fields.size()),
+                          value_types[pick(value_types.size())]});
+      }
+      for (size_t m = 0; m < options.methods_per_class; ++m) {
+        TestMethod method{.class_name = clazz.name,
+                          .name = "m" + std::to_string(methods.size()),
+                          .dex = clazz.dex};
+        method.return_type = pick(4) == 0 ? "V" : value_types[pick(value_types.size())];
+        for (auto count = pick(4); method.parameters.size() < count;) {
+          method.parameters.push_back(value_types[pick(value_types.size())]);
+        }
+        method.shorty = Shorty(method.return_type);
+        for (const auto &parameter : method.parameters) method.shorty += Shorty(parameter);
+        // every third method overloads the one before it, if their parameters differ
+        if (m % 3 == 2 && methods.back().parameters != method.parameters) {
+          method.name = methods.back().name;
+        }
+        methods.push_back(std::move(method));
+      }
+    }
+
+    // the code may call any method, including those of other dexs
+    for (auto &method : methods) {
+      for (auto count = pick(7); count > 0; --count) {
+        switch (pick(6)) {
+          case 0:
+            method.strings.push_back(strings[pick(strings.size())]);
+            break;
+          case 1:
+            method.callees.push_back(methods[pick(methods.size())].Signature());
+            break;
+          case 2:
+            method.getting.push_back(pick(fields.size()));
+            break;
+          case 3:
+            method.setting.push_back(pick(fields.size()));
+            break;
+          case 4: {
+            auto usage = static_cast<unsigned>(pick(DexHelper::kTypeUsageCount));
+            auto type = types[pick(types.size())];
+            // new-instance takes a class and the array makers an array type
+            if (usage == DexHelper::kNewInstance && type[0] == '[') type = types[0];
+            if ((usage == DexHelper::kNewArray || usage == DexHelper::kFilledNewArray) &&
+                type[0] != '[') {
+              type = "[" + type;
+            }
+            method.types.emplace_back(usage, type);
+            break;
+          }
+          case 5:
+            method.numbers.push_back(numbers[pick(numbers.size())]);
+            break;
+        }
+      }
+    }
+
+    // only earlier classes are above a class, so the hierarchy has no cycles
+    for (size_t c = 1; c < classes.size(); ++c) {
+      if (pick(3) != 0) classes[c].superclass = classes[pick(c)].name;
+      for (auto count = pick(3); count > 0; --count) {
+        const auto &interface = classes[pick(c)].name;
+        auto &interfaces = classes[c].interfaces;
+        if (interface != classes[c].superclass &&
+            std::find(interfaces.begin(), interfaces.end(), interface) == interfaces.end()) {
+          interfaces.push_back(interface);
+        }
+      }
+    }
+
+    // classes declare some of the virtual methods, calls name them on any class
+    const std::vector<std::vector<std::string>> virtual_parameters = {{}, {"I"}, {"[I", "J"}};
+    auto virtual_method = [&](const TestClass &clazz, size_t v) {
+      TestMethod method{.class_name = clazz.name,
+                        .name = "v" + std::to_string(v),
+                        .return_type = v == 2 ? "I" : "V",
+                        .parameters = virtual_parameters[v],
+                        .dex = clazz.dex,
+                        .is_virtual = true};
+      method.shorty = Shorty(method.return_type);
+      for (const auto &parameter : method.parameters) method.shorty += Shorty(parameter);
+      return method;
+    };
+    const auto static_methods = methods.size();
+    for (const auto &clazz : classes) {
+      for (size_t v = 0; v < virtual_parameters.size(); ++v) {
+        if (pick(3) == 0) methods.push_back(virtual_method(clazz, v));
+      }
+    }
+    for (size_t m = 0; m < static_methods; ++m) {
+      if (pick(2) == 0) continue;
+      const auto &clazz = classes[pick(classes.size())];
+      auto ref = virtual_method(clazz, pick(virtual_parameters.size()));
+      if (!FindMethod(ref.Signature())) refs.push_back(ref);
+      methods[m].callees.push_back(ref.Signature());
+    }
+
+    for (size_t dex = 0; dex < options.dex_count; ++dex) Build(dex);
+  }
+
+  const TestClass *FindClass(const std::string &name) const {
+    for (const auto &clazz : classes) {
+      if (clazz.name == name) return &clazz;
+    }
+    return nullptr;
+  }
+
+  // the helper's constructor argument
+  std::vector<std::tuple<const void *, size_t, const void *, size_t>> dexs() const {
+    std::vector<std::tuple<const void *, size_t, const void *, size_t>> out;
+    for (const auto &image : images_) out.emplace_back(image.data(), image.size(), nullptr, 0);
+    return out;
+  }
+
+  const TestMethod *FindMethod(const std::string &signature) const {
+    for (const auto *list : {&methods, &refs}) {
+      for (const auto &method : *list) {
+        if (method.Signature() == signature) return &method;
+      }
+    }
+    return nullptr;
+  }
+
+  std::string FieldName(size_t field) const {
+    return fields[field].class_name + "->" + fields[field].name + ":" + fields[field].type;
+  }
+
+private:
+  static char Shorty(const std::string &type) { return type[0] == '[' ? 'L' : type[0]; }
+
+  static Prototype ToPrototype(const TestMethod &method) {
+    std::vector<TypeDescriptor> parameters;
+    for (const auto &parameter : method.parameters) {
+      parameters.push_back(TypeDescriptor::FromDescriptor(parameter));
+    }
+    return Prototype{TypeDescriptor::FromDescriptor(method.return_type), parameters};
+  }
+
+  void Build(size_t dex) {
+    DexBuilder dex_file;
+    // the code of a method is only copied when the image is created
+    std::deque<ClassBuilder> class_builders;
+    std::deque<MethodBuilder> method_builders;
+    auto type_id = [&](const std::string &type) {
+      return Value::Type(dex_file.GetOrAddType(type)->orig_index);
+    };
+    auto field_id = [&](size_t field) {
+      return dex_file
+          .GetOrAddField(TypeDescriptor::FromDescriptor(fields[field].class_name),
+                         fields[field].name, TypeDescriptor::FromDescriptor(fields[field].type))
+          ->orig_index;
+    };
+    for (const auto &clazz : classes) {
+      if (clazz.dex != dex) continue;
+      // MakeClass takes a dotted name
+      auto &cbuilder = class_builders.emplace_back(
+          dex_file.MakeClass(clazz.name.substr(1, clazz.name.size() - 2)));
+      cbuilder.setSuperClass(TypeDescriptor::FromDescriptor(clazz.superclass));
+      for (const auto &interface : clazz.interfaces) {
+        cbuilder.addInterface(TypeDescriptor::FromDescriptor(interface));
+      }
+      for (const auto &field : fields) {
+        if (field.class_name != clazz.name) continue;
+        cbuilder.CreateField(field.name, TypeDescriptor::FromDescriptor(field.type)).Encode();
+      }
+      for (const auto &method : methods) {
+        if (method.class_name != clazz.name) continue;
+        auto &builder =
+            method_builders.emplace_back(cbuilder.CreateMethod(method.name, ToPrototype(method)));
+        if (method.is_virtual) builder.access_flags(::dex::kAccPublic);
+        LiveRegister r{builder.AllocRegister()};
+        for (const auto &str : method.strings) builder.BuildConstString(r, str);
+        for (const auto &signature : method.callees) {
+          const auto &callee = *FindMethod(signature);
+          const auto &decl = dex_file.GetOrDeclareMethod(
+              TypeDescriptor::FromDescriptor(callee.class_name), callee.name, ToPrototype(callee));
+          builder.AddInstruction(callee.is_virtual ? Instruction::InvokeVirtual(decl.id, {}, r)
+                                                   : Instruction::InvokeStatic(decl.id, {}));
+        }
+        for (auto field : method.getting) {
+          builder.AddInstruction(Instruction::GetStaticField(field_id(field), r));
+        }
+        for (auto field : method.setting) {
+          builder.AddInstruction(Instruction::SetStaticField(field_id(field), r));
+        }
+        for (const auto &[usage, type] : method.types) {
+          if (usage == DexHelper::kNewInstance) {
+            builder.AddInstruction(Instruction::OpWithArgs(Instruction::Op::kNew, r, type_id(type)));
+          } else if (usage == DexHelper::kNewArray) {
+            builder.AddInstruction(
+                Instruction::OpWithArgs(Instruction::Op::kNewArray, r, r, type_id(type)));
+          } else if (usage == DexHelper::kCheckCast) {
+            builder.AddInstruction(Instruction::Cast(r, type_id(type)));
+          } else if (usage == DexHelper::kInstanceOf) {
+            builder.AddInstruction(Instruction::InstanceOf(r, r, type_id(type)));
+          } else if (usage == DexHelper::kConstClass) {
+            builder.AddInstruction(Instruction::ConstClass(r, type_id(type)));
+          } else {
+            // methods alternate between the two forms of filled-new-array
+            auto type_index = type_id(type).value();
+            builder.AddInstruction(
+                (&method - methods.data()) % 2 == 0
+                    ? Instruction::FilledNewArray(type_index, r, r)
+                    : Instruction::FilledNewArrayRange(type_index, r, r, 1));
+          }
+        }
+        for (auto number : method.numbers) {
+          // the wide forms sign extend 16 or 32 bits, so only non-negative ints that fit
+          // are loaded through them
+          bool wide = number >= 0 && number <= 32767 && number % 2 == 0;
+          builder.AddInstruction(Instruction::OpWithArgs(
+              wide ? Instruction::Op::kMoveWide : Instruction::Op::kMove, r,
+              Value::Immediate(static_cast<size_t>(number))));
+        }
+        builder.BuildReturn();
+        builder.Encode();
+      }
+    }
+    auto image = dex_file.CreateImage();
+    images_.emplace_back(image.ptr<const uint8_t>(), image.ptr<const uint8_t>() + image.size());
+  }
+
+  std::vector<std::vector<uint8_t>> images_;
+};
+
+// the signatures of methods, sorted since the order of most results depends on which
+// query scanned a method first
+inline std::vector<std::string> Signatures(const DexHelper &helper,
+                                           const std::vector<size_t> &methods) {
+  std::vector<std::string> out;
+  for (auto method_idx : methods) {
+    auto method = helper.DecodeMethod(method_idx);
+    std::string signature = std::string(method.declaring_class.name) + "->" +
+                            std::string(method.name) + "(";
+    for (const auto &parameter : method.parameters) signature += parameter.name;
+    out.push_back(signature + ")" + std::string(method.return_type.name));
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+inline std::vector<std::string> Signatures(const std::vector<const TestMethod *> &methods) {
+  std::vector<std::string> out;
+  for (const auto *method : methods) out.push_back(method->Signature());
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+inline size_t MethodIndex(const DexHelper &helper, const TestMethod &method) {
+  std::vector<std::string_view> parameters(method.parameters.begin(), method.parameters.end());
+  return helper.CreateMethodIndex(method.class_name, method.name, parameters);
+}
+
+inline size_t FieldIndex(const DexHelper &helper, const TestField &field) {
+  return helper.CreateFieldIndex(field.class_name, field.name);
+}
+
+using Query = std::function<std::vector<std::string>(const DexHelper &)>;
+
+// a query of each kind for every string, type and number and some methods and fields, each
+// creating the indices it needs by name. results are in Signatures order
+inline std::vector<std::pair<std::string, Query>> MakeQueries(const TestDexs &dexs) {
+  std::vector<std::pair<std::string, Query>> queries;
+  const std::vector<size_t> any;
+  for (const auto &str : dexs.strings) {
+    for (bool prefix : {false, true}) {
+      queries.emplace_back("string " + str + (prefix ? " prefix" : ""),
+                           [str, prefix, any](const DexHelper &helper) {
+                             return Signatures(helper, helper.FindMethodUsingString(
+                                                           str, prefix, -1, -1, "", -1, any, any,
+                                                           any, false));
+                           });
+    }
+  }
+  queries.emplace_back("strings", [&dexs](const DexHelper &helper) {
+    std::vector<DexHelper::StringQuery> batch;
+    for (const auto &str : dexs.strings) batch.push_back({.str = str});
+    std::vector<std::string> out;
+    for (const auto &methods : helper.FindMethodUsingStrings(batch, {})) {
+      auto signatures = Signatures(helper, methods);
+      out.insert(out.end(), signatures.begin(), signatures.end());
+      out.push_back("|");
+    }
+    return out;
+  });
+  queries.emplace_back("substring version", [any](const DexHelper &helper) {
+    return Signatures(helper, helper.FindMethodUsingSubstring("version", false, -1, -1, "", -1,
+                                                              any, any, any, false));
+  });
+  queries.emplace_back("similar hello", [any](const DexHelper &helper) {
+    return Signatures(helper, helper.FindMethodUsingSimilarString("hello", 2, -1, -1, "", -1,
+                                                                  any, any, any, false));
+  });
+  for (size_t i = 0; i < dexs.methods.size(); i += 3) {
+    const auto *method = &dexs.methods[i];
+    queries.emplace_back("invoking " + method->Signature(), [method, any](const DexHelper &helper) {
+      return Signatures(helper, helper.FindMethodInvoking(MethodIndex(helper, *method), -1, -1,
+                                                          "", -1, any, any, any, false));
+    });
+    queries.emplace_back("invoked " + method->Signature(), [method, any](const DexHelper &helper) {
+      return Signatures(helper, helper.FindMethodInvoked(MethodIndex(helper, *method), -1, -1, "",
+                                                         -1, any, any, any, false));
+    });
+  }
+  for (size_t i = 0; i < dexs.fields.size(); i += 2) {
+    const auto *field = &dexs.fields[i];
+    queries.emplace_back("getting " + field->name, [field, any](const DexHelper &helper) {
+      return Signatures(helper, helper.FindMethodGettingField(FieldIndex(helper, *field), -1, -1,
+                                                              "", -1, any, any, any, false));
+    });
+    queries.emplace_back("setting " + field->name, [field, any](const DexHelper &helper) {
+      return Signatures(helper, helper.FindMethodSettingField(FieldIndex(helper, *field), -1, -1,
+                                                              "", -1, any, any, any, false));
+    });
+  }
+  for (const auto &type : dexs.types) {
+    queries.emplace_back("type " + type, [type, any](const DexHelper &helper) {
+      return Signatures(helper, helper.FindMethodUsingType(helper.CreateClassIndex(type), ~0u, -1,
+                                                           -1, "", -1, any, any, any, false));
+    });
+  }
+  for (auto number : dexs.numbers) {
+    queries.emplace_back("number " + std::to_string(number), [number, any](const DexHelper &helper) {
+      return Signatures(helper, helper.FindMethodUsingNumber(number, -1, -1, "", -1, any, any, any,
+                                                             false));
+    });
+  }
+  queries.emplace_back("number range", [any](const DexHelper &helper) {
+    return Signatures(helper, helper.FindMethodUsingNumberRange(-2, 1000, -1, -1, "", -1, any,
+                                                                any, any, false));
+  });
+  queries.emplace_back("signature", [any](const DexHelper &helper) {
+    return Signatures(helper, helper.FindMethodBySignature(helper.CreateClassIndex("V"), any, "",
+                                                           any, false));
+  });
+  return queries;
+}
+inline int failures = 0;
+
+// reports the difference if actual is not expected
+inline void ExpectEqual(const std::string &what, const std::vector<std::string> &expected,
+                        const std::vector<std::string> &actual) {
+  if (expected == actual) return;
+  ++failures;
+  std::cerr << "FAIL " << what << "\n  expected:";
+  for (const auto &s : expected) std::cerr << " " << s;
+  std::cerr << "\n  actual:  ";
+  for (const auto &s : actual) std::cerr << " " << s;
+  std::cerr << std::endl;
+}
+
+inline void Expect(const std::string &what, bool ok) {
+  if (ok) return;
+  ++failures;
+  std::cerr << "FAIL " << what << std::endl;
+}
+
+}  // namespace dex_helper_testing
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "slicer/dex_utf8.h"
+
+// Compares dex::Utf8Cmp, which skips the shared ASCII prefix a vector at a time, with the
+// scalar loop it replaced on descriptor-like strings, and checks both agree. The strings
+// are also placed right before an inaccessible page to catch reads past their end.
+
+namespace {
+constexpr size_t kStringCount = 20000;
+constexpr int kRounds = 50;
+
+// the comparison before the vector prefix skip
+unsigned ScalarNext(const char **s) {
+  unsigned one = static_cast<unsigned char>(*(*s)++);
+  if ((one & 0x80) != 0) {
+    unsigned two = static_cast<unsigned char>(*(*s)++);
+    if ((one & 0x20) != 0) {
+      unsigned three = static_cast<unsigned char>(*(*s)++);
+      return ((one & 0x0f) << 12) | ((two & 0x3f) << 6) | (three & 0x3f);
+    }
+    return ((one & 0x1f) << 6) | (two & 0x3f);
+  }
+  return one;
+}
+
+int ScalarUtf8Cmp(const char *s1, const char *s2) {
+  for (;;) {
+    if (*s1 == '\0') {
+      return *s2 == '\0' ? 0 : -1;
+    } else if (*s2 == '\0') {
+      return 1;
+    }
+    int diff = int(ScalarNext(&s1)) - int(ScalarNext(&s2));
+    if (diff != 0) {
+      return diff;
+    }
+  }
+}
+
+int Sign(int value) { return (value > 0) - (value < 0); }
+
+std::vector<std::string> GenerateStrings() {
+  static const char *kPackages[] = {"Landroid/view/", "Landroidx/recyclerview/widget/",
+                                    "Lcom/google/android/material/", "Lkotlin/jvm/internal/",
+                                    "L\xc3\xa9t\xc3\xa9/", "Lj/"};
+  std::vector<std::string> strings;
+  uint32_t seed = 1;
+  for (size_t i = 0; i < kStringCount; ++i) {
+    seed = seed * 1103515245 + 12345;
+    std::string s = kPackages[(seed >> 16) % std::size(kPackages)];
+    s += "Class" + std::to_string((seed >> 8) % 1000);
+    if (seed % 7 == 0) s += "$Inner\xe2\x82\xac";
+    if (seed % 3 == 0) s += "$" + std::to_string(seed % 50);
+    strings.push_back(s + ";");
+  }
+  return strings;
+}
+
+// compares every string with the next one in sorted order, which share the longest prefixes
+template <typename Compare>
+double TimePerComparison(const std::vector<const char *> &sorted, Compare compare, long &sink) {
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; ++round) {
+    for (size_t i = 1; i < sorted.size(); ++i) {
+      sink += compare(sorted[i - 1], sorted[i]);
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / (double(kRounds) * double(sorted.size() - 1));
+}
+
+// both strings end right before a PROT_NONE page, at the alignments their lengths give
+bool CheckPageEnd(const std::vector<std::string> &strings) {
+  long page = sysconf(_SC_PAGESIZE);
+  auto *map = static_cast<char *>(
+      mmap(nullptr, page * 4, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (map == MAP_FAILED) {
+    std::cerr << "cannot map guard pages" << std::endl;
+    return false;
+  }
+  mprotect(map + page, page, PROT_NONE);
+  mprotect(map + page * 3, page, PROT_NONE);
+  bool ok = true;
+  for (size_t i = 1; i < std::min<size_t>(strings.size(), 200) && ok; ++i) {
+    const auto &a = strings[i - 1];
+    const auto &b = strings[i];
+    char *s1 = map + page - a.size() - 1;
+    char *s2 = map + page * 3 - b.size() - 1;
+    memcpy(s1, a.c_str(), a.size() + 1);
+    memcpy(s2, b.c_str(), b.size() + 1);
+    ok = Sign(dex::Utf8Cmp(s1, s2)) == Sign(ScalarUtf8Cmp(s1, s2)) &&
+         Sign(dex::Utf8Cmp(s2, s1)) == Sign(ScalarUtf8Cmp(s2, s1));
+  }
+  munmap(map, page * 4);
+  return ok;
+}
+}  // namespace
+
+int main() {
+  auto strings = GenerateStrings();
+  std::vector<const char *> sorted;
+  for (const auto &s : strings) sorted.push_back(s.c_str());
+  std::sort(sorted.begin(), sorted.end(),
+            [](const char *a, const char *b) { return ScalarUtf8Cmp(a, b) < 0; });
+
+  for (const char *a : sorted) {
+    for (const char *b : {sorted.front(), sorted[sorted.size() / 2], sorted.back(), a}) {
+      if (Sign(dex::Utf8Cmp(a, b)) != Sign(ScalarUtf8Cmp(a, b))) {
+        std::cerr << "mismatch: " << a << " " << b << std::endl;
+        return 1;
+      }
+    }
+  }
+  for (size_t i = 1; i < sorted.size(); ++i) {
+    if (Sign(dex::Utf8Cmp(sorted[i - 1], sorted[i])) !=
+        Sign(ScalarUtf8Cmp(sorted[i - 1], sorted[i]))) {
+      std::cerr << "mismatch: " << sorted[i - 1] << " " << sorted[i] << std::endl;
+      return 1;
+    }
+  }
+  if (!CheckPageEnd(strings)) {
+    std::cerr << "mismatch at a page end" << std::endl;
+    return 1;
+  }
+
+  long sink = 0;
+  double scalar = TimePerComparison(sorted, ScalarUtf8Cmp, sink);
+  double vector = TimePerComparison(sorted, dex::Utf8Cmp, sink);
+  std::cout << "scalar: " << scalar << " ns/comparison" << std::endl;
+  std::cout << "vector: " << vector << " ns/comparison" << std::endl;
+  // keeps the comparisons from being optimized out
+  std::cout << "checksum: " << sink << std::endl;
+  return 0;
+}
@@ -276,9 +276,13 @@ public:
     kBranchEqz,
     kBranchNEqz,
     kCheckCast,
+    kConstClass,
+    kFilledNewArray,
+    kFilledNewArrayRange,
     kGetInstanceField,
     kGetStaticField,
     kGetStaticObjectField,
+    kInstanceOf,
     kInvokeDirect,
     kInvokeInterface,
     kInvokeStatic,
@@ -333,6 +337,36 @@ public:
     return OpWithArgs(Op::kCheckCast, val, type);
   }
 
+  // A type check. Basically, `dest = val instanceof type`
+  static inline Instruction InstanceOf(Value dest, Value val, Value type) {
+    assert(type.is_type());
+    return OpWithArgs(Op::kInstanceOf, dest, val, type);
+  }
+
+  // Loads the class object of a type. Basically, `dest = type.class`
+  static inline Instruction ConstClass(Value dest, Value type) {
+    assert(type.is_type());
+    return OpWithArgs(Op::kConstClass, dest, type);
+  }
+
+  // An array of the array type at type_index, filled with args. Encoded like an
+  // invoke, with the array moved to dest.
+  template <typename... T>
+  static inline Instruction FilledNewArray(size_t type_index,
+                                           std::optional<const Value> dest,
+                                           const T &...args) {
+    return Instruction{Op::kFilledNewArray,       type_index,
+                       /*result_is_object=*/true, false,      dest, args...};
+  }
+  static inline Instruction FilledNewArrayRange(size_t type_index,
+                                                std::optional<const Value> dest,
+                                                const Value &first,
+                                                size_t length) {
+    return Instruction{Op::kFilledNewArrayRange,  type_index,
+                       /*result_is_object=*/true, false,      dest, first,
+                       Value::Immediate(length)};
+  }
+
   // For method calls.
   template <typename... T>
   static inline Instruction InvokeVirtual(size_t index_argument,
@@ -567,6 +601,8 @@ public:
 
   ClassBuilder setSuperClass(const TypeDescriptor &type);
 
+  ClassBuilder addInterface(const TypeDescriptor &type);
+
   DexBuilder *parent() const { return parent_; }
 
   const TypeDescriptor &descriptor() const { return type_descriptor_; }
@@ -676,6 +712,8 @@ private:
   void EncodeBranch(::dex::Opcode op, const Instruction &instruction);
   void EncodeNew(const Instruction &instruction);
   void EncodeCast(const Instruction &instruction);
+  void EncodeInstanceOf(const Instruction &instruction);
+  void EncodeConstClass(const Instruction &instruction);
   void EncodeFieldOp(const Instruction &instruction);
   void EncodeNewArray(const Instruction &instruction);
   void EncodeAput(const Instruction &instruction);
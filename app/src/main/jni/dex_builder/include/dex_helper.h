@@ -1,16 +1,72 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
 #include <string_view>
+#include <thread>
 #include <parallel_hashmap/phmap.h>
 #include <vector>
 
 #include "slicer/reader.h"
 
+// all queries, index creation and caching may be called concurrently from any thread
 class DexHelper {
 public:
-    DexHelper(const std::vector<std::tuple<const void *, size_t, const void *, size_t>> &dexs);
+    // threads > 1 builds the per-dex tables on a pool of that many workers.
+    // if snapshot_path names a snapshot matching all dexs, the tables are mapped from it instead.
+    // lazy defers building each dex until the first query that reaches it.
+    // no_cache makes queries read the code they need without caching or marking anything
+    // scanned, for a few one-shot lookups. CreateFullCache and warmup still cache.
+    DexHelper(const std::vector<std::tuple<const void *, size_t, const void *, size_t>> &dexs,
+              size_t threads = 1, std::string_view snapshot_path = {}, bool lazy = false,
+              bool no_cache = false);
 
-    void CreateFullCache() const;
+    ~DexHelper();
+
+    // threads > 1 scans disjoint method ranges on that many workers, the result is the same
+    void CreateFullCache(size_t threads = 1) const;
+
+    // scans every method on a background thread, dexs in dex_priority order. queries meanwhile
+    // use whatever is scanned already and only scan the rest themselves.
+    // does nothing while a previous warmup is still running
+    void StartWarmup(const std::vector<size_t> &dex_priority = {}) const;
+
+    void PauseWarmup() const;
+
+    void ResumeWarmup() const;
+
+    // stops the warmup and waits for it, what it scanned so far stays cached
+    void CancelWarmup() const;
+
+    // methods passed by the warmup, and how many it will pass in total
+    std::tuple<size_t, size_t> GetWarmupProgress() const;
+
+    // freezes the search result caches into offsets + values arrays. queries keep working on
+    // them and a later scan thaws only what it has to append to, so call it after CreateFullCache.
+    // lazy dexs not built yet are left alone
+    void Compact() const;
+
+    // bytes held by the search result caches, pages mapped from a snapshot and lazy dexs not
+    // built yet are not counted
+    size_t GetCacheMemoryUsage() const;
+
+    // interns the descriptor of every type, method and field of all dexs once, so that each
+    // (dex, id) gets its canonical index up front and resolving one turns into a table lookup
+    // instead of string searches in every dex. indices already handed out are kept
+    void CreateGlobalIndices() const;
+
+    // fully caches and writes all tables to snapshot_path for a later launch to map. the global
+    // indices are written only if CreateGlobalIndices already built them
+    bool SaveSnapshot(std::string_view snapshot_path) const;
+
+    bool IsSnapshotLoaded() const { return snapshot_ != nullptr; }
 
     std::vector<size_t> FindMethodUsingString(std::string_view str, bool match_prefix,
                                               size_t return_type, short parameter_count,
@@ -21,6 +77,50 @@ public:
                                               const std::vector<size_t> &dex_priority,
                                               bool find_first) const;
 
+    // FindMethodUsingString for every string containing str, or with regex every string with a
+    // match of the regex str anywhere in it. the regex is an ECMAScript subset on bytes:
+    // literals, '.', classes like [a-z] and [^0-9], \d \w \s and their negations, '^', '$',
+    // '*', '+' and '?' after one atom, and '|' between whole alternatives. an invalid regex
+    // finds nothing
+    std::vector<size_t> FindMethodUsingSubstring(std::string_view str, bool regex,
+                                                 size_t return_type, short parameter_count,
+                                                 std::string_view parameter_shorty,
+                                                 size_t declaring_class,
+                                                 const std::vector<size_t> &parameter_types,
+                                                 const std::vector<size_t> &contains_parameter_types,
+                                                 const std::vector<size_t> &dex_priority,
+                                                 bool find_first) const;
+
+    // FindMethodUsingString for every string within max_distance byte insertions, deletions
+    // and substitutions of str, the methods using nearer strings first. meant to find strings
+    // that changed slightly between versions, such as a bumped version number
+    std::vector<size_t> FindMethodUsingSimilarString(std::string_view str, size_t max_distance,
+                                                     size_t return_type, short parameter_count,
+                                                     std::string_view parameter_shorty,
+                                                     size_t declaring_class,
+                                                     const std::vector<size_t> &parameter_types,
+                                                     const std::vector<size_t> &contains_parameter_types,
+                                                     const std::vector<size_t> &dex_priority,
+                                                     bool find_first) const;
+
+    // the arguments of one FindMethodUsingString call
+    struct StringQuery {
+        std::string_view str;
+        bool match_prefix = false;
+        size_t return_type = size_t(-1);
+        short parameter_count = -1;
+        std::string_view parameter_shorty;
+        size_t declaring_class = size_t(-1);
+        std::vector<size_t> parameter_types;
+        std::vector<size_t> contains_parameter_types;
+        bool find_first = false;
+    };
+
+    // out[i] -> FindMethodUsingString(queries[i]), but every dex is scanned in one pass for all
+    // of them, and a find_first query stops taking part once it is answered
+    std::vector<std::vector<size_t>> FindMethodUsingStrings(const std::vector<StringQuery> &queries,
+                                                            const std::vector<size_t> &dex_priority) const;
+
     std::vector<size_t> FindMethodInvoking(size_t method_idx, size_t return_type,
                                            short parameter_count, std::string_view parameter_shorty,
                                            size_t declaring_class,
@@ -37,6 +137,47 @@ public:
                                           const std::vector<size_t> &dex_priority,
                                           bool find_first) const;
 
+    // FindMethodInvoked for every call that may dispatch to method_idx at run time: calls
+    // naming the same name and proto on its class, its superclasses and interfaces, or the
+    // subclasses and implementations inheriting it without overriding it, in any dex. calls
+    // to a direct method only dispatch through its own class and the subclasses inheriting it.
+    // any dex may declare a subtype, so the hierarchy of every dex is built first: on a lazy
+    // helper this builds all dexs, whatever dex_priority narrows the callers to
+    std::vector<size_t> FindMethodInvokedByDispatch(size_t method_idx, size_t return_type,
+                                                    short parameter_count,
+                                                    std::string_view parameter_shorty,
+                                                    size_t declaring_class,
+                                                    const std::vector<size_t> &parameter_types,
+                                                    const std::vector<size_t> &contains_parameter_types,
+                                                    const std::vector<size_t> &dex_priority,
+                                                    bool find_first) const;
+
+    // the methods up to max_depth calls away from method_idx that match the filters, nearest
+    // first, FindMethodInvoking applied level by level but with each method visited once.
+    // threads > 1 expands wide levels on that many workers, the result is the same. a worker
+    // holds the lock of the dex it searches, which is only shared once the dex is fully
+    // scanned (CreateFullCache) or with no_cache, so before that workers wait on each other
+    // in the same dex
+    std::vector<size_t> FindReachableMethods(size_t method_idx, size_t max_depth,
+                                             size_t return_type, short parameter_count,
+                                             std::string_view parameter_shorty,
+                                             size_t declaring_class,
+                                             const std::vector<size_t> &parameter_types,
+                                             const std::vector<size_t> &contains_parameter_types,
+                                             const std::vector<size_t> &dex_priority,
+                                             bool find_first, size_t threads = 1) const;
+
+    // FindReachableMethods following FindMethodInvoked, the methods reaching method_idx. the
+    // callers of a level are found with one pass over each dex, the dexs on parallel workers
+    std::vector<size_t> FindCallersTransitive(size_t method_idx, size_t max_depth,
+                                              size_t return_type, short parameter_count,
+                                              std::string_view parameter_shorty,
+                                              size_t declaring_class,
+                                              const std::vector<size_t> &parameter_types,
+                                              const std::vector<size_t> &contains_parameter_types,
+                                              const std::vector<size_t> &dex_priority,
+                                              bool find_first, size_t threads = 1) const;
+
     std::vector<size_t> FindMethodGettingField(size_t field_idx, size_t return_type,
                                                short parameter_count,
                                                std::string_view parameter_shorty,
@@ -55,9 +196,74 @@ public:
                                                const std::vector<size_t> &dex_priority,
                                                bool find_first) const;
 
+    // how a method uses a type in its code, the kinds of FindMethodUsingType are a mask of
+    // 1 << TypeUsage bits
+    enum TypeUsage : uint8_t {
+        kNewInstance,
+        kNewArray,
+        kCheckCast,
+        kInstanceOf,
+        kConstClass,
+        kFilledNewArray,
+        kTypeUsageCount,
+    };
+
+    // methods using class_idx in one of kinds. new-array and filled-new-array use the array
+    // type, e.g. "[Ljava/lang/String;". a method is listed once per kind it uses the type in
+    std::vector<size_t> FindMethodUsingType(size_t class_idx, unsigned kinds, size_t return_type,
+                                            short parameter_count,
+                                            std::string_view parameter_shorty,
+                                            size_t declaring_class,
+                                            const std::vector<size_t> &parameter_types,
+                                            const std::vector<size_t> &contains_parameter_types,
+                                            const std::vector<size_t> &dex_priority,
+                                            bool find_first) const;
+
+    // methods with a const literal or a switch case key of value. a literal is the 64-bit value
+    // its register gets, so an int -1 is -1 for every const opcode, and a float or double is
+    // its bit pattern
+    std::vector<size_t> FindMethodUsingNumber(int64_t value, size_t return_type,
+                                              short parameter_count,
+                                              std::string_view parameter_shorty,
+                                              size_t declaring_class,
+                                              const std::vector<size_t> &parameter_types,
+                                              const std::vector<size_t> &contains_parameter_types,
+                                              const std::vector<size_t> &dex_priority,
+                                              bool find_first) const;
+
+    // FindMethodUsingNumber for any value in [lower, upper]. after Compact the literals are
+    // sorted, and a range is found by binary search
+    std::vector<size_t> FindMethodUsingNumberRange(int64_t lower, int64_t upper, size_t return_type,
+                                                   short parameter_count,
+                                                   std::string_view parameter_shorty,
+                                                   size_t declaring_class,
+                                                   const std::vector<size_t> &parameter_types,
+                                                   const std::vector<size_t> &contains_parameter_types,
+                                                   const std::vector<size_t> &dex_priority,
+                                                   bool find_first) const;
+
+    // methods by signature alone, with the same filters as the queries above
+    std::vector<size_t> FindMethodBySignature(size_t return_type,
+                                              const std::vector<size_t> &parameter_types,
+                                              std::string_view parameter_shorty,
+                                              const std::vector<size_t> &dex_priority,
+                                              bool find_first) const;
+
     std::vector<size_t> FindField(size_t type, const std::vector<size_t> &dex_priority,
                                   bool find_first) const;
 
+    // the classes declaring class_idx as their superclass, or with transitive every class below
+    // it, nearer ones first. subclasses defined in any dex are found
+    std::vector<size_t> FindSubclasses(size_t class_idx, bool transitive) const;
+
+    // every class and interface that can be assigned to interface_idx: those listing it as an
+    // interface, and all their subclasses and implementations, nearer ones first
+    std::vector<size_t> FindImplementations(size_t interface_idx) const;
+
+    // the superclasses of class_idx nearest first, up to the first one no dex defines, which is
+    // java.lang.Object or a framework class
+    std::vector<size_t> FindSuperclasses(size_t class_idx) const;
+
     struct Class {
         const std::string_view name;
     };
@@ -82,69 +288,575 @@ public:
     Field DecodeField(size_t field_idx) const;
     Method DecodeMethod(size_t method_idx) const;
 
+    // build_times[dex] -> milliseconds spent preprocessing that dex, 0 if a lazy dex is not built yet
+    const std::vector<double> &GetBuildTimes() const { return build_times_; }
+
 private:
+    // array built in memory or borrowed from a mapped snapshot
+    template <typename T>
+    class Table {
+    public:
+        void assign(std::vector<T> &&owned) {
+            owned_ = std::move(owned);
+            data_ = owned_.data();
+            size_ = owned_.size();
+        }
+        void borrow(const T *data, size_t size) {
+            owned_ = decltype(owned_)();
+            data_ = data;
+            size_ = size;
+        }
+        const T &operator[](size_t i) const { return data_[i]; }
+        size_t size() const { return size_; }
+        const T *begin() const { return data_; }
+        const T *end() const { return data_ + size_; }
+
+    private:
+        std::vector<T> owned_;
+        const T *data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // string data is kept as offsets from the start of the dex data section
+    struct StringRef {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    // keys[str_id] packs the leading characters of each string so that most binary search
+    // steps compare one integer instead of decoding MUTF-8
+    class StringPool {
+    public:
+        void assign(const char *base, std::vector<StringRef> &&refs, std::vector<uint64_t> &&keys) {
+            base_ = base;
+            refs_.assign(std::move(refs));
+            keys_.assign(std::move(keys));
+        }
+        void borrow(const char *base, const StringRef *refs, const uint64_t *keys, size_t size) {
+            base_ = base;
+            refs_.borrow(refs, size);
+            keys_.borrow(keys, size);
+        }
+        std::string_view operator[](size_t i) const {
+            return {base_ + refs_[i].offset, refs_[i].size};
+        }
+        size_t size() const { return refs_.size(); }
+        // index of the first string not less than str, and of the first string after
+        // all those starting with prefix, in dex order
+        uint32_t LowerBound(std::string_view str) const;
+        uint32_t PrefixUpperBound(std::string_view prefix) const;
+        const Table<StringRef> &refs() const { return refs_; }
+        const Table<uint64_t> &keys() const { return keys_; }
+
+    private:
+        const char *base_ = nullptr;
+        Table<StringRef> refs_;
+        Table<uint64_t> keys_;
+    };
+
+    // key -> ids. grows while methods are scanned; frozen it is offsets + values,
+    // either owned after Freeze() or borrowed from a mapped snapshot
+    class PostingLists {
+    public:
+        void resize(size_t size) { lists_.resize(size); }
+        // frozen, offsets has one more entry than there are keys
+        void assign(std::vector<uint32_t> &&offsets, std::vector<uint32_t> &&values) {
+            lists_ = decltype(lists_)();
+            owned_offsets_ = std::move(offsets);
+            owned_values_ = std::move(values);
+            offsets_ = owned_offsets_.data();
+            values_ = owned_values_.data();
+            frozen_size_ = owned_offsets_.size() - 1;
+        }
+        void borrow(const uint32_t *offsets, const uint32_t *values, size_t size) {
+            lists_ = decltype(lists_)();
+            owned_offsets_ = decltype(owned_offsets_)();
+            owned_values_ = decltype(owned_values_)();
+            offsets_ = offsets;
+            values_ = values;
+            frozen_size_ = size;
+        }
+        void emplace_back(size_t key, uint32_t value) {
+            if (offsets_) Thaw();
+            lists_[key].emplace_back(value);
+        }
+        std::span<const uint32_t> operator[](size_t key) const {
+            if (offsets_) return {values_ + offsets_[key], values_ + offsets_[key + 1]};
+            return lists_[key];
+        }
+        size_t size() const { return offsets_ ? frozen_size_ : lists_.size(); }
+        void Freeze();
+        size_t MemoryUsage() const;
+
+    private:
+        void Thaw();
+
+        std::vector<std::vector<uint32_t>> lists_;
+        std::vector<uint32_t> owned_offsets_;
+        std::vector<uint32_t> owned_values_;
+        const uint32_t *offsets_ = nullptr;
+        const uint32_t *values_ = nullptr;
+        size_t frozen_size_ = 0;
+    };
+
+    // (value, method_id) of the number literals, in scan order while growing. frozen they are
+    // sorted by value, either owned after Freeze() or borrowed from a mapped snapshot
+    class NumberLists {
+    public:
+        void emplace_back(int64_t value, uint32_t method_id) {
+            if (!owned_) Own();
+            owned_values_.emplace_back(value);
+            owned_method_ids_.emplace_back(method_id);
+            values_ = owned_values_.data();
+            method_ids_ = owned_method_ids_.data();
+            ++size_;
+            sorted_ = false;
+        }
+        void borrow(const int64_t *values, const uint32_t *method_ids, size_t size) {
+            owned_values_ = decltype(owned_values_)();
+            owned_method_ids_ = decltype(owned_method_ids_)();
+            values_ = values;
+            method_ids_ = method_ids;
+            size_ = size;
+            owned_ = false;
+            sorted_ = true;
+        }
+        size_t size() const { return size_; }
+        int64_t value(size_t i) const { return values_[i]; }
+        uint32_t method_id(size_t i) const { return method_ids_[i]; }
+        // the entries with a value in [lower, upper] are [first, last), or with sorted false
+        // the entries of that range still have to be checked one by one
+        std::pair<size_t, size_t> Find(int64_t lower, int64_t upper, bool *sorted) const;
+        // the entries sorted by value, scan order kept among equal values
+        std::pair<std::vector<int64_t>, std::vector<uint32_t>> Sorted() const;
+        void Freeze();
+        size_t MemoryUsage() const;
+
+    private:
+        void Own();
+
+        std::vector<int64_t> owned_values_;
+        std::vector<uint32_t> owned_method_ids_;
+        const int64_t *values_ = nullptr;
+        const uint32_t *method_ids_ = nullptr;
+        size_t size_ = 0;
+        bool owned_ = true;
+        bool sorted_ = true;
+    };
+
+    // index -> the (dex, id) of every dex having it, in dex order, only appended to. most
+    // symbols are in few dexs, so only those are stored. rows and members live in blocks that
+    // never move, and each block doubles the previous one, so published entries can be read
+    // without locking
+    class IndexTable {
+    public:
+        struct Member {
+            uint32_t dex;
+            uint32_t id;
+        };
+        class Row {
+        public:
+            Row(const Member *members, size_t size) : members_(members), size_(size) {}
+            // the id in dex_idx, dex::kNoIndex if it has none
+            uint32_t operator[](size_t dex_idx) const {
+                for (const auto &member : *this) {
+                    if (member.dex == dex_idx) return member.id;
+                    if (member.dex > dex_idx) break;
+                }
+                return dex::kNoIndex;
+            }
+            const Member *begin() const { return members_; }
+            const Member *end() const { return members_ + size_; }
+
+        private:
+            const Member *members_;
+            size_t size_;
+        };
+
+        // the most members of a row, the number of dexs
+        void set_width(size_t width) {
+            first_members_ = std::max(kFirstBlockSize, std::bit_ceil(width));
+        }
+        Row operator[](size_t index) const {
+            auto [block, offset] = Locate(kFirstBlockSize, index);
+            const auto &row = rows_[block][offset];
+            auto [member_block, member_offset] = Locate(first_members_, row.first);
+            return {members_[member_block].get() + member_offset, row.size};
+        }
+        size_t size() const { return size_.load(std::memory_order_acquire); }
+        // writers must be serialized, members in dex order
+        size_t push_back(std::span<const Member> members);
+
+    private:
+        static constexpr size_t kFirstBlockSize = 64;
+
+        struct RowRef {
+            uint32_t first;
+            uint32_t size;
+        };
+
+        static std::pair<size_t, size_t> Locate(size_t first_block_size, size_t index) {
+            size_t block = std::bit_width(index / first_block_size + 1) - 1;
+            return {block, index - first_block_size * ((1zu << block) - 1)};
+        }
+
+        size_t first_members_ = kFirstBlockSize;
+        std::array<std::unique_ptr<RowRef[]>, 48> rows_;
+        std::array<std::unique_ptr<Member[]>, 48> members_;
+        // the position of the next member, never splitting a row across blocks
+        size_t member_count_ = 0;
+        std::atomic_size_t size_ = 0;
+    };
+
+    // exclusive while queries may still scan dex_idx and append to its caches,
+    // shared once it is fully scanned or with no_cache, when they only read
+    class DexLock {
+    public:
+        DexLock(std::shared_mutex &mutex, bool shared) : mutex_(mutex), shared_(shared) {
+            shared_ ? mutex_.lock_shared() : mutex_.lock();
+        }
+        ~DexLock() { shared_ ? mutex_.unlock_shared() : mutex_.unlock(); }
+        DexLock(const DexLock &) = delete;
+        DexLock &operator=(const DexLock &) = delete;
+
+    private:
+        std::shared_mutex &mutex_;
+        const bool shared_;
+    };
+
+    DexLock LockDex(size_t dex_idx) const;
+
+    void InitDex(size_t dex_idx);
+
+    // builds dex_idx exactly once, must precede any use of its preprocessed tables
+    void EnsureDex(size_t dex_idx) const;
+
+    void BuildDex(size_t dex_idx);
+
+    bool LoadSnapshot(std::string_view snapshot_path);
+
+    void Warmup(const std::vector<size_t> &dex_order) const;
+
     std::tuple<std::vector<std::vector<uint32_t>>, std::vector<std::vector<uint32_t>>>
     ConvertParameters(const std::vector<size_t> &parameter_types,
                       const std::vector<size_t> &contains_parameter_types) const;
 
     std::vector<size_t> GetPriority(const std::vector<size_t> &priority) const;
 
-    bool ScanMethod(size_t dex_idx, uint32_t method_id, size_t str_lower = size_t(-1),
-                    size_t str_upper = size_t(-1)) const;
+    // relations collected from method code, each is a search result cache
+    enum ScanRelation : uint8_t {
+        kUsingString,
+        kInvoking,
+        kInvoked,
+        kGetting,
+        kSetting,
+        kUsingType,
+        kUsingNumber,  // the key is the 64-bit literal
+        kScanRelationCount,
+    };
+
+    // the caches a scan appends to
+    struct ScanCaches {
+        std::array<PostingLists *, kUsingNumber> lists;
+        NumberLists *numbers;
+        void emplace_back(ScanRelation relation, uint64_t key, uint32_t value) const {
+            if (relation == kUsingNumber) {
+                numbers->emplace_back(static_cast<int64_t>(key), value);
+            } else {
+                lists[relation]->emplace_back(key, value);
+            }
+        }
+    };
+
+    ScanCaches GetScanCaches(size_t dex_idx) const;
+
+    // sorted, disjoint [lower, upper) runs of ids
+    using IdRanges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+    static bool InRanges(const IdRanges &ranges, uint32_t id);
+
+    // callers hold the lock of dex_idx exclusively. true if the method uses one of strings
+    bool ScanMethod(size_t dex_idx, uint32_t method_id, const IdRanges &strings = {}) const;
+
+    // decodes the code of method_id and calls emit(relation, key, value) in instruction order,
+    // for the relations in the kRelations mask of 1 << relation bits
+    template <unsigned kRelations = (1u << kScanRelationCount) - 1, typename Emit>
+    void ScanCode(size_t dex_idx, uint32_t method_id, Emit &&emit) const;
 
     std::tuple<uint32_t, uint32_t> FindPrefixStringId(size_t dex_idx,
                                                       std::string_view to_find) const;
 
+    // the lookups below read the sorted id sections of the dex directly,
+    // so resolving names never forces a lazy dex to be built
     uint32_t FindPrefixStringIdExact(size_t dex_idx, std::string_view to_find) const;
 
-    bool IsMethodMatch(size_t dex_id, uint32_t method_id, uint32_t return_type,
-                       short parameter_count, std::string_view parameter_shorty,
-                       uint32_t declaring_class, const std::vector<uint32_t> &parameter_types,
-                       const std::vector<uint32_t> &contains_parameter_types) const;
+    std::string_view GetString(size_t dex_idx, uint32_t str_id) const;
+
+    uint32_t FindTypeId(size_t dex_idx, uint32_t str_id) const;
+
+    // the filters of a method query resolved in one dex, uint32_t(-2), -1 or empty match any
+    struct MethodFilter {
+        uint32_t return_type = uint32_t(-2);
+        short parameter_count = -1;
+        // str_id of the shorty
+        uint32_t shorty = uint32_t(-2);
+        uint32_t declaring_class = uint32_t(-2);
+        const std::vector<uint32_t> *parameter_types = nullptr;
+        const std::vector<uint32_t> *contains_parameter_types = nullptr;
+    };
+
+    MethodFilter GetMethodFilter(size_t dex_idx, size_t return_type, short parameter_count,
+                                 std::string_view parameter_shorty, size_t declaring_class,
+                                 const std::vector<uint32_t> &parameter_types,
+                                 const std::vector<uint32_t> &contains_parameter_types) const;
+
+    // the filters a MethodFilter sets, IsMethodMatch is specialized on them
+    enum MatchFilter : unsigned {
+        kMatchDeclaringClass = 1 << 0,
+        kMatchReturnType = 1 << 1,
+        kMatchShorty = 1 << 2,
+        // parameter count, types and contained types
+        kMatchParameters = 1 << 3,
+        kMatchFilterCount = 1 << 4,
+    };
+
+    static unsigned GetMatchFilters(const MethodFilter &filter);
+
+    // checks only the filters in kFilters, which must be GetMatchFilters(filter). reads the
+    // method columns and only falls back to the type list for parameters past the first
+    template <unsigned kFilters>
+    bool IsMethodMatch(size_t dex_id, uint32_t method_id, const MethodFilter &filter) const;
+
+    using MethodMatcher = bool (DexHelper::*)(size_t, uint32_t, const MethodFilter &) const;
+
+    // the IsMethodMatch specialization for filter, for loops that mix filters
+    static MethodMatcher GetMethodMatcher(const MethodFilter &filter);
+
+    // returns fn(is_match), where is_match(method_id) is the IsMethodMatch specialization for
+    // filter, so the loops in fn are compiled once per filter set without the unset checks
+    template <typename Fn>
+    bool WithMethodMatcher(size_t dex_idx, const MethodFilter &filter, Fn &&fn) const;
+
+    // IsMethodMatch without the declaring class
+    bool IsProtoMatch(size_t dex_id, uint32_t proto_id, const MethodFilter &filter) const;
+
+    // the method ids a scan loop has to try, plan[i] for i in [first, last). that is a run of
+    // method ids, or with methods set, positions in that sorted list
+    struct MethodPlan {
+        uint32_t first = 0;
+        uint32_t last = 0;
+        std::vector<uint32_t> methods;
+        uint32_t operator[](uint32_t i) const { return methods.empty() ? i : methods[i]; }
+    };
+
+    // the methods that can pass IsMethodMatch with filter: none if a filter is absent from the
+    // dex, else the methods of declaring_class or of the fewest signature index entries,
+    // whichever is smaller, else all. a run left with signature filters is narrowed further
+    // by a pass over the method columns
+    MethodPlan PlanMethodScan(size_t dex_idx, const MethodFilter &filter) const;
+
+    // the kRelation entries of the code of method_id with one of keys, read without caching
+    template <ScanRelation kRelation>
+    size_t CountRelation(size_t dex_idx, uint32_t method_id, const IdRanges &keys) const;
+
+    // the literals in [lower, upper] in the code of method_id, read without caching
+    size_t CountNumbers(size_t dex_idx, uint32_t method_id, int64_t lower, int64_t upper) const;
+
+    // the per-dex body of FindMethodUsingString for the strings in strings, callers hold the
+    // lock of dex_idx from LockDex. true if find_first and one was found
+    bool FindMethodUsingStringIds(size_t dex_idx, const IdRanges &strings,
+                                  const MethodFilter &filter, bool find_first,
+                                  std::vector<size_t> &out) const;
+
+    // the str_ids of dex_idx that FindMethodUsingSubstring matches, false if regex is invalid.
+    // candidates come from the trigram index, only strings without a trigram of str are
+    // checked one by one
+    bool FindMatchingStringIds(size_t dex_idx, std::string_view str, bool regex,
+                               IdRanges &out) const;
+
+    // out[d] -> the str_ids of dex_idx at edit distance d from str, for d up to max_distance,
+    // out ends at the farthest one found. candidates share enough trigrams with str, unless str
+    // is too short for any to be certain
+    void FindSimilarStringIds(size_t dex_idx, std::string_view str, size_t max_distance,
+                              std::vector<IdRanges> &out) const;
+
+    // built on first use
+    const PostingLists &GetTrigramIndex(size_t dex_idx) const;
+
+    enum MethodDeclaration : uint8_t { kUndeclared, kDirectMethod, kVirtualMethod };
+
+    // builds subclass_cache_, implementation_cache_, override_cache_ and method_declarations_
+    // of dex_idx on first use
+    void EnsureHierarchy(size_t dex_idx) const;
+
+    // the classes directly below class_idx, breadth first through all levels with transitive.
+    // with implementations the classes implementing one are below it too
+    std::vector<size_t> FindSubtypes(size_t class_idx, bool implementations, bool transitive) const;
+
+    // the proto_id of dex_idx with the types of from_proto_id in from_dex_idx, dex::kNoIndex if
+    // there is none
+    uint32_t FindProtoId(size_t dex_idx, size_t from_dex_idx, uint32_t from_proto_id) const;
+
+    // the method_ids of dex_idx named name_id with proto_id on any class, in method_id order.
+    // callers ran EnsureHierarchy
+    std::span<const uint32_t> GetOverrideGroup(size_t dex_idx, uint32_t name_id,
+                                               uint32_t proto_id) const;
+
+    // out[dex] -> the method_ids a call may name to dispatch to method_idx. builds the
+    // hierarchy of every dex
+    std::vector<IdRanges> FindDispatchingMethodIds(size_t method_idx) const;
+
+    // appends the methods under any of keys in the kRelation cache that match filter, after
+    // scanning the methods that may still add to it, or with no_cache reading those directly.
+    // callers hold the lock of dex_idx from LockDex. true if find_first and one was found.
+    // found_keys, if given, gets the key each appended method was found under
+    template <ScanRelation kRelation>
+    bool FindRelatedMethods(size_t dex_idx, const IdRanges &keys, const MethodFilter &filter,
+                            bool find_first, std::vector<size_t> &out,
+                            std::vector<uint32_t> *found_keys = nullptr) const;
+
+    // appends the callees of method_idx in the dexs of dex_priority
+    void FindCallees(size_t method_idx, const std::vector<size_t> &dex_priority,
+                     std::vector<size_t> &out) const;
+
+    // appends the callers of methods[i] in the dexs of dex_priority to out[i], with one
+    // FindRelatedMethods over all of methods per dex. dexs are searched on up to threads workers
+    void FindCallers(const std::vector<size_t> &methods, const std::vector<size_t> &dex_priority,
+                     size_t threads, std::vector<std::vector<size_t>> &out) const;
+
+    // the body of FindReachableMethods and FindCallersTransitive, a breadth-first search over
+    // FindCallees or FindCallers
+    template <ScanRelation kRelation>
+    std::vector<size_t> FindMethodsTransitive(size_t method_idx, size_t max_depth,
+                                              size_t return_type, short parameter_count,
+                                              std::string_view parameter_shorty,
+                                              size_t declaring_class,
+                                              const std::vector<size_t> &parameter_types,
+                                              const std::vector<size_t> &contains_parameter_types,
+                                              const std::vector<size_t> &dex_priority,
+                                              bool find_first, size_t threads) const;
+
+    // returns the existing index of any of ids, or appends them as a new one. ids[dex] is
+    // dex::kNoIndex for the dexs without it
+    size_t AddIndex(IndexTable &indices, std::vector<std::vector<size_t>> &rev,
+                    const std::vector<uint32_t> &ids) const;
 
     size_t CreateMethodIndex(size_t dex_idx, uint32_t method_id) const;
     size_t CreateClassIndex(size_t dex_idx, uint32_t class_id) const;
     size_t CreateFieldIndex(size_t dex_idx, uint32_t field_id) const;
 
+    // keys[dex][id] -> key, grouped as members[offsets[key]..offsets[key + 1]] in dex order, in
+    // time and space linear in the ids
+    static std::pair<std::vector<uint32_t>, std::vector<IndexTable::Member>> GroupMembers(
+        const std::vector<std::span<const uint32_t>> &keys, size_t key_count);
+
+    void BuildGlobalIndices() const;
+
     std::vector<dex::Reader> readers_;
 
     // for interface
-    // indices[method_index][dex] -> id
-    mutable std::vector<std::vector<uint32_t>> method_indices_;
-    mutable std::vector<std::vector<uint32_t>> class_indices_;
-    mutable std::vector<std::vector<uint32_t>> field_indices_;
+    // indices[method_index][dex] -> id, see IndexTable
+    mutable IndexTable method_indices_;
+    mutable IndexTable class_indices_;
+    mutable IndexTable field_indices_;
+    // guards appending to the indices above and the reverse maps below
+    mutable std::mutex index_mutex_;
     // rev[dex][method_id] -> method_index
     mutable std::vector<std::vector<size_t>> rev_method_indices_;  // for each dex
     mutable std::vector<std::vector<size_t>> rev_class_indices_;
     mutable std::vector<std::vector<size_t>> rev_field_indices_;
+    // every id of every dex has its entry in the reverse maps, which no longer change
+    mutable std::atomic_bool global_indices_ready_ = false;
+    mutable std::once_flag global_indices_built_;
 
     // for preprocess
     // strings[dex][str_id] -> str
-    std::vector<std::vector<std::string_view>> strings_;
-    // method_codes[dex][method_id] -> code
-    std::vector<std::vector<const dex::CodeItem *>> method_codes_;
+    std::vector<StringPool> strings_;
+    // method_codes[dex][method_id] -> code offset, 0 if none
+    std::vector<Table<uint32_t>> method_codes_;
+    // method_columns[dex].column[method_id], the fields IsMethodMatch filters on without
+    // going through the proto
+    struct MethodColumns {
+        Table<uint16_t> class_ids;
+        Table<uint16_t> return_types;
+        Table<uint16_t> parameter_counts;
+        // type of the first parameter, uint16_t(-1) if none
+        Table<uint16_t> first_parameters;
+        // str_id of the shorty
+        Table<uint32_t> shorties;
+    };
+    std::vector<MethodColumns> method_columns_;
 
     // for cache
-    // type_cache[dex][str_id] -> type_id
-    std::vector<std::vector<uint32_t>> type_cache_;
-    // field_cache[dex][type_id][str_id] -> method_ids
-    std::vector<std::vector<phmap::flat_hash_map<uint32_t, std::vector<uint32_t>>>> method_cache_;
-    // field_cache[dex][type_id][str_id] -> field_id
-    std::vector<std::vector<phmap::flat_hash_map<uint32_t, uint32_t>>> field_cache_;
     // class_cache[dex][type_id] -> class_id
-    std::vector<std::vector<uint32_t>> class_cache_;
+    std::vector<Table<uint32_t>> class_cache_;
 
     // search result cache
     // string_cache[dex][str_id] -> method_ids
-    mutable std::vector<std::vector<std::vector<uint32_t>>> string_cache_;
+    mutable std::vector<PostingLists> string_cache_;
     // invoking_cache[dex][method_id] -> method_ids
-    mutable std::vector<std::vector<std::vector<uint32_t>>> invoking_cache_;
+    mutable std::vector<PostingLists> invoking_cache_;
     // invoked_cache[dex][method_id] -> method_ids
-    mutable std::vector<std::vector<std::vector<uint32_t>>> invoked_cache_;
+    mutable std::vector<PostingLists> invoked_cache_;
     // getting/setting_cache[dex][field_id] -> method_ids
-    mutable std::vector<std::vector<std::vector<uint32_t>>> getting_cache_;
-    mutable std::vector<std::vector<std::vector<uint32_t>>> setting_cache_;
-    mutable std::vector<std::vector<std::vector<uint32_t>>> declaring_cache_;
+    mutable std::vector<PostingLists> getting_cache_;
+    mutable std::vector<PostingLists> setting_cache_;
+    // type_cache[dex][type_id * kTypeUsageCount + usage] -> method_ids
+    mutable std::vector<PostingLists> type_cache_;
+    // number_cache[dex] -> (literal, method_id)
+    mutable std::vector<NumberLists> number_cache_;
+    // declaring_cache[dex][type_id] -> field_ids
+    std::vector<PostingLists> declaring_cache_;
+    // signature index
+    // shorty_cache[dex][str_id] -> proto_ids with that shorty
+    std::vector<PostingLists> shorty_cache_;
+    // parameter_cache[dex][type_id] -> proto_ids with a parameter of that type
+    std::vector<PostingLists> parameter_cache_;
+    // proto_cache[dex][proto_id] -> method_ids
+    std::vector<PostingLists> proto_cache_;
+    // trigram_cache[dex][hash of 3 bytes] -> sorted str_ids of the strings containing them
+    mutable std::vector<PostingLists> trigram_cache_;
+    mutable std::unique_ptr<std::once_flag[]> trigrams_built_;
+    mutable std::unique_ptr<std::atomic_bool[]> trigrams_ready_;
+    // subclass_cache[dex][type_id] -> type_ids of the classes extending it
+    mutable std::vector<PostingLists> subclass_cache_;
+    // implementation_cache[dex][type_id] -> type_ids of the classes and interfaces listing it
+    // as an interface
+    mutable std::vector<PostingLists> implementation_cache_;
+    // override_cache[dex] -> method_ids sorted by name_idx and proto_idx, so that the refs
+    // overriding each other are adjacent
+    mutable std::vector<Table<uint32_t>> override_cache_;
+    // method_declarations[dex][method_id] -> how the class data of the dex declares it
+    mutable std::vector<std::vector<MethodDeclaration>> method_declarations_;
+    mutable std::unique_ptr<std::once_flag[]> hierarchy_built_;
+    mutable std::unique_ptr<std::atomic_bool[]> hierarchy_ready_;
     // for method search
     mutable std::vector<std::vector<bool>> searched_methods_;
+
+    // built[dex]
+    std::unique_ptr<std::once_flag[]> built_;
+    // ready[dex] -> built, for lookups that use the tables if present but never build them
+    std::unique_ptr<std::atomic_bool[]> ready_;
+    // dex_locks[dex] -> guards its search result caches and searched methods
+    std::unique_ptr<std::shared_mutex[]> dex_locks_;
+    // fully_scanned[dex] -> every method is cached, queries only read its caches from then on
+    std::unique_ptr<std::atomic_bool[]> fully_scanned_;
+    // queries scan without caching, see the constructor
+    bool no_cache_ = false;
+
+    // background warmup, paused and cancelled are guarded by warmup_mutex_
+    mutable std::mutex warmup_mutex_;
+    mutable std::condition_variable warmup_resumed_;
+    mutable std::thread warmup_;
+    mutable bool warmup_paused_ = false;
+    mutable bool warmup_cancelled_ = false;
+    mutable std::atomic_size_t warmup_progress_ = 0;
+    mutable std::atomic_size_t warmup_total_ = 0;
+
+    // mapped snapshot backing the tables above, if any
+    const void *snapshot_ = nullptr;
+    size_t snapshot_size_ = 0;
+
+    // build_times[dex] -> ms
+    std::vector<double> build_times_;
 };
@@ -95,6 +95,9 @@ class Reader {
     return reinterpret_cast<const T*>(image_ + offset);
   }
 
+  // Start of the data section, which every dataPtr() offset is relative to
+  const dex::u1* DataBegin() const { return data_; }
+
   // Convert a data section file pointer (absolute offset) to an in-memory pointer
   // (offset should be inside the data section)
   template <class T>
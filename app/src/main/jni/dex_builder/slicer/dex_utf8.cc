@@ -16,8 +16,112 @@
 
 #include "slicer/dex_format.h"
 
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace dex {
 
+#if defined(__SSE2__) || defined(__aarch64__)
+static constexpr size_t kVectorSize = 16;
+
+// For the loads of whole aligned blocks, which may read past the end of a
+// string, see LoadString.
+#define NO_SANITIZE_BLOCK \
+  __attribute__((no_sanitize("address", "hwaddress", "thread")))
+
+#if defined(__SSE2__)
+using Vector = __m128i;
+
+NO_SANITIZE_BLOCK
+static Vector LoadAligned(const char* p) {
+  return _mm_load_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static Vector LoadUnaligned(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static void StoreAligned(char* p, Vector v) {
+  _mm_store_si128(reinterpret_cast<__m128i*>(p), v);
+}
+
+// One bit per byte
+static uint64_t ZeroMask(Vector v) {
+  return unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())));
+}
+static constexpr unsigned kMaskBits = 1;
+#else
+using Vector = uint8x16_t;
+
+NO_SANITIZE_BLOCK
+static Vector LoadAligned(const char* p) {
+  return vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+}
+
+static Vector LoadUnaligned(const char* p) {
+  return vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+}
+
+static void StoreAligned(char* p, Vector v) {
+  vst1q_u8(reinterpret_cast<uint8_t*>(p), v);
+}
+
+// Narrowed to 4 bits per byte to get a scalar mask
+static uint64_t ZeroMask(Vector v) {
+  return vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(vceqzq_u8(v)), 4)), 0);
+}
+static constexpr unsigned kMaskBits = 4;
+#endif
+
+// Loads the next kVectorSize bytes of s without touching memory past the
+// aligned block holding its terminator. Aligned blocks match the 16 byte
+// granules of memory tagging (MTE, HWASan), so no load leaves the granules
+// of the string's allocation, nor its page. Bytes past the terminator are
+// still read up to the end of its block, hence the sanitizer exclusions.
+NO_SANITIZE_BLOCK
+static Vector LoadString(const char* s) {
+  uintptr_t offset = reinterpret_cast<uintptr_t>(s) & (kVectorSize - 1);
+  const char* block = s - offset;
+  if (offset == 0 || (ZeroMask(LoadAligned(block)) >> (offset * kMaskBits)) == 0) {
+    // the string continues into the next block
+    return LoadUnaligned(s);
+  }
+  // the string ends in this block, shift it to the start of a vector
+  alignas(kVectorSize) char buffer[kVectorSize * 2];
+  StoreAligned(buffer, LoadAligned(block));
+  StoreAligned(buffer + kVectorSize, Vector{});
+  return LoadUnaligned(buffer + offset);
+}
+
+// Index of the first byte where the strings differ, s1 ends or either
+// string has a non-ASCII byte, or kVectorSize if the next kVectorSize
+// bytes are the same ASCII characters in both.
+static size_t AsciiPrefixLength(const char* s1, const char* s2) {
+  Vector a = LoadString(s1);
+  Vector b = LoadString(s2);
+#if defined(__SSE2__)
+  unsigned differ = ~_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xffff;
+  unsigned end = _mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm_setzero_si128()));
+  unsigned non_ascii = _mm_movemask_epi8(_mm_or_si128(a, b));
+  unsigned stop = differ | end | non_ascii;
+  return stop ? __builtin_ctz(stop) : kVectorSize;
+#else
+  uint8x16_t stop = vorrq_u8(vmvnq_u8(vceqq_u8(a, b)), vceqzq_u8(a));
+  stop = vorrq_u8(stop, vcltzq_s8(vreinterpretq_s8_u8(vorrq_u8(a, b))));
+  // narrow to 4 bits per byte to get a scalar mask
+  uint64_t mask = vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+  return mask ? __builtin_ctzll(mask) / 4 : kVectorSize;
+#endif
+}
+#endif
+
 // Retrieve the next UTF-16 character from a UTF-8 string.
 // Advances "*pUtf8Ptr" to the start of the next character.
 //
@@ -48,6 +152,19 @@ static u2 GetUtf16FromUtf8(const char** pUtf8Ptr) {
 
 int Utf8Cmp(const char* s1, const char* s2) {
   for (;;) {
+#if defined(__SSE2__) || defined(__aarch64__)
+    // Skip the common ASCII prefix a vector at a time, the loop below
+    // then handles the first character that is not shared plain ASCII.
+    for (;;) {
+      size_t length = AsciiPrefixLength(s1, s2);
+      s1 += length;
+      s2 += length;
+      if (length != kVectorSize) {
+        break;
+      }
+    }
+#endif
+
     if (*s1 == '\0') {
       if (*s2 == '\0') {
         return 0;
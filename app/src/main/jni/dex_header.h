@@ -12,7 +12,22 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingString(
         jstring str, jboolean match_prefix, jlong return_type, jshort parameter_count, jstring parameter_shorty,
         jlong declaring_class, jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
 
-JNIEXPORT jlong JNICALL Java_com_rarnu_dex_DexHelper_load(JNIEnv *env, jobject thiz, jobject class_loader);
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingSubstring(
+        JNIEnv *env, jobject thiz,
+        jstring str, jboolean regex, jlong return_type, jshort parameter_count, jstring parameter_shorty,
+        jlong declaring_class, jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingSimilarString(
+        JNIEnv *env, jobject thiz,
+        jstring str, jint max_distance, jlong return_type, jshort parameter_count, jstring parameter_shorty,
+        jlong declaring_class, jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
+
+JNIEXPORT jobjectArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingStrings(
+        JNIEnv *env, jobject thiz,
+        jobjectArray strs, jbooleanArray match_prefix, jlongArray return_type, jshortArray parameter_count, jobjectArray parameter_shorty,
+        jlongArray declaring_class, jobjectArray parameter_types, jobjectArray contains_parameter_types, jbooleanArray find_first, jintArray dex_priority);
+
+JNIEXPORT jlong JNICALL Java_com_rarnu_dex_DexHelper_load(JNIEnv *env, jobject thiz, jobject class_loader, jstring snapshot_path, jboolean lazy, jboolean no_cache);
 
 JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoking(
         JNIEnv *env, jobject thiz,
@@ -24,6 +39,21 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoked(
         jlong method_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
         jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
 
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvokedByDispatch(
+        JNIEnv *env, jobject thiz,
+        jlong method_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findReachableMethods(
+        JNIEnv *env, jobject thiz,
+        jlong method_index, jint max_depth, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findCallersTransitive(
+        JNIEnv *env, jobject thiz,
+        jlong method_index, jint max_depth, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
+
 JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodSettingField(
         JNIEnv *env, jobject thiz,
         jlong field_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
@@ -34,10 +64,35 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodGettingField
         jlong field_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
         jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
 
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingType(
+        JNIEnv *env, jobject thiz,
+        jlong class_index, jint kinds, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingNumber(
+        JNIEnv *env, jobject thiz,
+        jlong value, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingNumberRange(
+        JNIEnv *env, jobject thiz,
+        jlong lower, jlong upper, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first);
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodBySignature(
+        JNIEnv *env, jobject thiz,
+        jlong return_type, jlongArray parameter_types, jstring parameter_shorty, jintArray dex_priority, jboolean find_first);
+
 JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findField(
         JNIEnv *env, jobject thiz,
         jlong type, jintArray dex_priority, jboolean find_first);
 
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findSubclasses(JNIEnv *env, jobject thiz, jlong class_index, jboolean transitive);
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findImplementations(JNIEnv *env, jobject thiz, jlong interface_index);
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findSuperclasses(JNIEnv *env, jobject thiz, jlong class_index);
+
 JNIEXPORT jobject JNICALL Java_com_rarnu_dex_DexHelper_decodeMethodIndex(JNIEnv *env, jobject thiz, jlong method_index);
 
 JNIEXPORT jobject JNICALL Java_com_rarnu_dex_DexHelper_decodeFieldIndex(JNIEnv *env, jobject thiz, jlong field_index);
@@ -54,6 +109,22 @@ JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_close(JNIEnv *env, jobject t
 
 JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_createFullCache(JNIEnv *env, jobject thiz);
 
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_createGlobalIndices(JNIEnv *env, jobject thiz);
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_startWarmup(JNIEnv *env, jobject thiz, jintArray dex_priority);
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_pauseWarmup(JNIEnv *env, jobject thiz);
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_resumeWarmup(JNIEnv *env, jobject thiz);
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_cancelWarmup(JNIEnv *env, jobject thiz);
+
+JNIEXPORT jfloat JNICALL Java_com_rarnu_dex_DexHelper_getWarmupProgress(JNIEnv *env, jobject thiz);
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_compact(JNIEnv *env, jobject thiz);
+
+JNIEXPORT jboolean JNICALL Java_com_rarnu_dex_DexHelper_saveSnapshot(JNIEnv *env, jobject thiz, jstring path);
+
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *);
 
 #ifdef __cplusplus
@@ -6,6 +6,7 @@
 #include <map>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 #include <zlib.h>
 
@@ -441,7 +442,202 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingString(
     return res;
 }
 
-JNIEXPORT jlong JNICALL Java_com_rarnu_dex_DexHelper_load(JNIEnv *env, jobject thiz, jobject class_loader) {
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingSubstring(
+        JNIEnv *env, jobject thiz,
+        jstring str, jboolean regex, jlong return_type, jshort parameter_count, jstring parameter_shorty,
+        jlong declaring_class, jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    if (!str) {
+        return env->NewLongArray(0);
+    }
+    auto str_ = env->GetStringUTFChars(str, nullptr);
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+    std::vector<size_t> contains_parameter_types_;
+    jlong *contains_parameter_types_elements = nullptr;
+    if (contains_parameter_types) {
+        contains_parameter_types_elements = env->GetLongArrayElements(contains_parameter_types, nullptr);
+        contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
+    }
+    auto out = helper->FindMethodUsingSubstring(str_, regex, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+
+    env->ReleaseStringUTFChars(str, str_);
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
+    }
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+
+    if (contains_parameter_types_elements) {
+        env->ReleaseLongArrayElements(contains_parameter_types, contains_parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingSimilarString(
+        JNIEnv *env, jobject thiz,
+        jstring str, jint max_distance, jlong return_type, jshort parameter_count, jstring parameter_shorty,
+        jlong declaring_class, jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    if (!str || max_distance < 0) {
+        return env->NewLongArray(0);
+    }
+    auto str_ = env->GetStringUTFChars(str, nullptr);
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+    std::vector<size_t> contains_parameter_types_;
+    jlong *contains_parameter_types_elements = nullptr;
+    if (contains_parameter_types) {
+        contains_parameter_types_elements = env->GetLongArrayElements(contains_parameter_types, nullptr);
+        contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
+    }
+    auto out = helper->FindMethodUsingSimilarString(str_, max_distance, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+
+    env->ReleaseStringUTFChars(str, str_);
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
+    }
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+
+    if (contains_parameter_types_elements) {
+        env->ReleaseLongArrayElements(contains_parameter_types, contains_parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jobjectArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingStrings(
+        JNIEnv *env, jobject thiz,
+        jobjectArray strs, jbooleanArray match_prefix, jlongArray return_type, jshortArray parameter_count, jobjectArray parameter_shorty,
+        jlongArray declaring_class, jobjectArray parameter_types, jobjectArray contains_parameter_types, jbooleanArray find_first, jintArray dex_priority) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    auto count = strs ? env->GetArrayLength(strs) : 0;
+    auto res = env->NewObjectArray(count, env->FindClass("[J"), nullptr);
+    if (!handler || !count) {
+        return res;
+    }
+    auto &[helper, _] = *handler;
+    // every per query array is as long as strs
+    auto match_prefix_elements = env->GetBooleanArrayElements(match_prefix, nullptr);
+    auto return_type_elements = env->GetLongArrayElements(return_type, nullptr);
+    auto parameter_count_elements = env->GetShortArrayElements(parameter_count, nullptr);
+    auto declaring_class_elements = env->GetLongArrayElements(declaring_class, nullptr);
+    auto find_first_elements = env->GetBooleanArrayElements(find_first, nullptr);
+    std::vector<size_t> dex_priority_;
+    if (dex_priority) {
+        auto dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    auto get_types = [env](jobjectArray types, jsize i) {
+        std::vector<size_t> out;
+        auto array = static_cast<jlongArray>(env->GetObjectArrayElement(types, i));
+        if (array) {
+            auto elements = env->GetLongArrayElements(array, nullptr);
+            out.assign(elements, elements + env->GetArrayLength(array));
+            env->ReleaseLongArrayElements(array, elements, JNI_ABORT);
+            env->DeleteLocalRef(array);
+        }
+        return out;
+    };
+
+    // the query strings point into these until the search is done
+    std::vector<std::tuple<jstring, const char *>> chars;
+    std::vector<DexHelper::StringQuery> queries(count);
+    auto get_chars = [env, &chars](jobjectArray array, jsize i) -> std::string_view {
+        auto str = static_cast<jstring>(env->GetObjectArrayElement(array, i));
+        if (!str) return {};
+        return std::get<1>(chars.emplace_back(str, env->GetStringUTFChars(str, nullptr)));
+    };
+    for (jsize i = 0; i < count; ++i) {
+        auto &query = queries[i];
+        query.str = get_chars(strs, i);
+        query.match_prefix = match_prefix_elements[i];
+        query.return_type = return_type_elements[i];
+        query.parameter_count = parameter_count_elements[i];
+        query.parameter_shorty = get_chars(parameter_shorty, i);
+        query.declaring_class = declaring_class_elements[i];
+        query.parameter_types = get_types(parameter_types, i);
+        query.contains_parameter_types = get_types(contains_parameter_types, i);
+        query.find_first = find_first_elements[i];
+    }
+    auto out = helper->FindMethodUsingStrings(queries, dex_priority_);
+
+    for (auto &[str, str_] : chars) {
+        env->ReleaseStringUTFChars(str, str_);
+        env->DeleteLocalRef(str);
+    }
+    env->ReleaseBooleanArrayElements(match_prefix, match_prefix_elements, JNI_ABORT);
+    env->ReleaseLongArrayElements(return_type, return_type_elements, JNI_ABORT);
+    env->ReleaseShortArrayElements(parameter_count, parameter_count_elements, JNI_ABORT);
+    env->ReleaseLongArrayElements(declaring_class, declaring_class_elements, JNI_ABORT);
+    env->ReleaseBooleanArrayElements(find_first, find_first_elements, JNI_ABORT);
+    for (jsize i = 0; i < count; ++i) {
+        auto methods = env->NewLongArray(static_cast<int>(out[i].size()));
+        auto methods_element = env->GetLongArrayElements(methods, nullptr);
+        for (size_t j = 0; j < out[i].size(); ++j) {
+            methods_element[j] = static_cast<jlong>(out[i][j]);
+        }
+        env->ReleaseLongArrayElements(methods, methods_element, 0);
+        env->SetObjectArrayElement(res, i, methods);
+        env->DeleteLocalRef(methods);
+    }
+    return res;
+}
+
+JNIEXPORT jlong JNICALL Java_com_rarnu_dex_DexHelper_load(JNIEnv *env, jobject thiz, jobject class_loader, jstring snapshot_path, jboolean lazy, jboolean no_cache) {
     if (!class_loader) {
         return 0;
     }
@@ -472,77 +668,400 @@ JNIEXPORT jlong JNICALL Java_com_rarnu_dex_DexHelper_load(JNIEnv *env, jobject t
         const auto *dex_files = reinterpret_cast<const MyDexFile **>(env->GetLongArrayElements(cookie, nullptr));
         std::vector<std::tuple<const void *, size_t, const void *, size_t>> dex_images;
 
-        if (!dex_files[0]) {
-            while (dex_file_length-- > 1) {
-                const auto *dex_file = dex_files[dex_file_length];
-                LOGD("Got dex file %d", dex_file_length);
-                if (!dex_file) {
-                    LOGD("Skip empty dex file");
-                    dex_images.clear();
-                    break;
-                }
-                if (dex::Reader::IsCompact(dex_file->begin_)) {
-                    LOGD("skip compact dex");
-                    dex_images.clear();
-                    break;
-                } else {
-                    dex_images.emplace_back(dex_file->begin_, dex_file->size_, nullptr, 0);
-                }
-            }
-        }
+        if (!dex_files[0]) {
+            while (dex_file_length-- > 1) {
+                const auto *dex_file = dex_files[dex_file_length];
+                LOGD("Got dex file %d", dex_file_length);
+                if (!dex_file) {
+                    LOGD("Skip empty dex file");
+                    dex_images.clear();
+                    break;
+                }
+                if (dex::Reader::IsCompact(dex_file->begin_)) {
+                    LOGD("skip compact dex");
+                    dex_images.clear();
+                    break;
+                } else {
+                    dex_images.emplace_back(dex_file->begin_, dex_file->size_, nullptr, 0);
+                }
+            }
+        }
+
+        if (dex_images.empty()) {
+            // contains compact dex, try to load from original file
+            auto file_name_obj = (jstring)env->GetObjectField(java_dex_file, file_name_field);
+            if (!file_name_obj) {
+                continue;
+            }
+            auto file_name = env->GetStringUTFChars(file_name_obj, nullptr);
+            LOGD("dex filename is %s", file_name);
+            auto map = MemMap(file_name);
+            if (!map.ok()) {
+                continue;
+            }
+            auto zip_file = ZipFile::Open(map);
+            if (zip_file) {
+                for (int idx = 1;; ++idx) {
+                    auto entry = zip_file->Find("classes" + (idx == 1 ? std::string() : std::to_string(idx)) + ".dex");
+                    if (entry) {
+                        auto uncompress = entry->uncompress();
+                        if (uncompress.ok()) {
+                            LOGD("uncompressed %.*s", static_cast<int>(entry->file_name().size()), entry->file_name().data());
+                            images.emplace_back(uncompress.addr(), uncompress.len(), nullptr, 0);
+                            maps.emplace_back(std::move(uncompress));
+                        } else {
+                            LOGW("failed to uncompressed %.*s", static_cast<int>(entry->file_name().size()), entry->file_name().data());
+                        }
+                    } else {
+                        break;
+                    }
+                }
+            } else {
+                images.emplace_back(map.addr(), map.len(), nullptr, 0);
+                maps.emplace_back(std::move(map));
+            }
+            env->ReleaseStringUTFChars(file_name_obj, file_name);
+            env->DeleteLocalRef(file_name_obj);
+        } else {
+            for (auto &image : dex_images) {
+                images.emplace_back(std::move(image));
+            }
+        }
+    }
+    if (images.empty()) {
+        return 0;
+    }
+    auto threads = std::max(std::thread::hardware_concurrency(), 1u);
+    auto snapshot_path_ = snapshot_path ? env->GetStringUTFChars(snapshot_path, nullptr) : nullptr;
+    auto helper = std::make_unique<DexHelper>(images, threads, snapshot_path_ ? snapshot_path_ : "", lazy, no_cache);
+    if (snapshot_path_) env->ReleaseStringUTFChars(snapshot_path, snapshot_path_);
+    LOGD("snapshot %s", helper->IsSnapshotLoaded() ? "loaded" : "not loaded");
+    const auto &build_times = helper->GetBuildTimes();
+    for (size_t i = 0; i < build_times.size(); ++i) {
+        LOGD("dex %zu built in %.2f ms", i, build_times[i]);
+    }
+    auto res = reinterpret_cast<jlong>(new Handler(std::move(helper), std::move(maps)));
+    env->SetLongField(thiz, token_field, res);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoking(
+        JNIEnv *env, jobject thiz,
+        jlong method_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements =env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+
+    std::vector<size_t> contains_parameter_types_;
+    jlong *contains_parameter_types_elements = nullptr;
+    if (contains_parameter_types) {
+        contains_parameter_types_elements = env->GetLongArrayElements(contains_parameter_types, nullptr);
+        contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
+    }
+
+    auto out = helper->FindMethodInvoking(method_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
+    }
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+    if (contains_parameter_types_elements) {
+        env->ReleaseLongArrayElements(contains_parameter_types, contains_parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoked(
+        JNIEnv *env, jobject thiz,
+        jlong method_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+    std::vector<size_t> contains_parameter_types_;
+    jlong *contains_parameter_types_elements = nullptr;
+    if (contains_parameter_types) {
+        contains_parameter_types_elements = env->GetLongArrayElements(contains_parameter_types, nullptr);
+        contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
+    }
+
+    auto out = helper->FindMethodInvoked(method_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
+    }
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+    if (contains_parameter_types_elements) {
+        env->ReleaseLongArrayElements(contains_parameter_types, contains_parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvokedByDispatch(
+        JNIEnv *env, jobject thiz,
+        jlong method_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+    std::vector<size_t> contains_parameter_types_;
+    jlong *contains_parameter_types_elements = nullptr;
+    if (contains_parameter_types) {
+        contains_parameter_types_elements = env->GetLongArrayElements(contains_parameter_types, nullptr);
+        contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
+    }
+
+    auto out = helper->FindMethodInvokedByDispatch(method_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
+    }
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+    if (contains_parameter_types_elements) {
+        env->ReleaseLongArrayElements(contains_parameter_types, contains_parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findReachableMethods(
+        JNIEnv *env, jobject thiz,
+        jlong method_index, jint max_depth, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+    std::vector<size_t> contains_parameter_types_;
+    jlong *contains_parameter_types_elements = nullptr;
+    if (contains_parameter_types) {
+        contains_parameter_types_elements = env->GetLongArrayElements(contains_parameter_types, nullptr);
+        contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
+    }
+
+    auto out = helper->FindReachableMethods(method_index, max_depth < 0 ? size_t(-1) : size_t(max_depth), return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first, std::max(std::thread::hardware_concurrency(), 1u));
+
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
+    }
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+    if (contains_parameter_types_elements) {
+        env->ReleaseLongArrayElements(contains_parameter_types, contains_parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findCallersTransitive(
+        JNIEnv *env, jobject thiz,
+        jlong method_index, jint max_depth, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+    std::vector<size_t> contains_parameter_types_;
+    jlong *contains_parameter_types_elements = nullptr;
+    if (contains_parameter_types) {
+        contains_parameter_types_elements = env->GetLongArrayElements(contains_parameter_types, nullptr);
+        contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
+    }
+
+    auto out = helper->FindCallersTransitive(method_index, max_depth < 0 ? size_t(-1) : size_t(max_depth), return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first, std::max(std::thread::hardware_concurrency(), 1u));
+
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
+    }
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+    if (contains_parameter_types_elements) {
+        env->ReleaseLongArrayElements(contains_parameter_types, contains_parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodSettingField(
+        JNIEnv *env, jobject thiz,
+        jlong field_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+
+    std::vector<size_t> contains_parameter_types_;
+    jlong *contains_parameter_types_elements = nullptr;
+    if (contains_parameter_types) {
+        contains_parameter_types_elements = env->GetLongArrayElements(contains_parameter_types, nullptr);
+        contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
+    }
 
-        if (dex_images.empty()) {
-            // contains compact dex, try to load from original file
-            auto file_name_obj = (jstring)env->GetObjectField(java_dex_file, file_name_field);
-            if (!file_name_obj) {
-                continue;
-            }
-            auto file_name = env->GetStringUTFChars(file_name_obj, nullptr);
-            LOGD("dex filename is %s", file_name);
-            auto map = MemMap(file_name);
-            if (!map.ok()) {
-                continue;
-            }
-            auto zip_file = ZipFile::Open(map);
-            if (zip_file) {
-                for (int idx = 1;; ++idx) {
-                    auto entry = zip_file->Find("classes" + (idx == 1 ? std::string() : std::to_string(idx)) + ".dex");
-                    if (entry) {
-                        auto uncompress = entry->uncompress();
-                        if (uncompress.ok()) {
-                            LOGD("uncompressed %.*s", static_cast<int>(entry->file_name().size()), entry->file_name().data());
-                            images.emplace_back(uncompress.addr(), uncompress.len(), nullptr, 0);
-                            maps.emplace_back(std::move(uncompress));
-                        } else {
-                            LOGW("failed to uncompressed %.*s", static_cast<int>(entry->file_name().size()), entry->file_name().data());
-                        }
-                    } else {
-                        break;
-                    }
-                }
-            } else {
-                images.emplace_back(map.addr(), map.len(), nullptr, 0);
-                maps.emplace_back(std::move(map));
-            }
-            env->ReleaseStringUTFChars(file_name_obj, file_name);
-            env->DeleteLocalRef(file_name_obj);
-        } else {
-            for (auto &image : dex_images) {
-                images.emplace_back(std::move(image));
-            }
-        }
+    auto out = helper->FindMethodSettingField(field_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
     }
-    if (images.empty()) {
-        return 0;
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
     }
-    auto res = reinterpret_cast<jlong>(new Handler(std::make_unique<DexHelper>(images), std::move(maps)));
-    env->SetLongField(thiz, token_field, res);
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+    if (contains_parameter_types_elements) {
+        env->ReleaseLongArrayElements(contains_parameter_types, contains_parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
     return res;
 }
 
-JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoking(
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodGettingField(
         JNIEnv *env, jobject thiz,
-        jlong method_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlong field_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
         jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
     auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
     if (!handler) {
@@ -556,10 +1075,11 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoking(
         dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
         dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
     }
+
     std::vector<size_t> parameter_types_;
     jlong *parameter_types_elements = nullptr;
     if (parameter_types) {
-        parameter_types_elements =env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
         parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
     }
 
@@ -570,7 +1090,7 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoking(
         contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
     }
 
-    auto out = helper->FindMethodInvoking(method_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+    auto out = helper->FindMethodGettingField(field_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
 
     if (parameter_shorty_) {
         env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
@@ -593,9 +1113,9 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoking(
     return res;
 }
 
-JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoked(
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingType(
         JNIEnv *env, jobject thiz,
-        jlong method_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlong class_index, jint kinds, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
         jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
     auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
     if (!handler) {
@@ -615,6 +1135,7 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoked(
         parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
         parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
     }
+
     std::vector<size_t> contains_parameter_types_;
     jlong *contains_parameter_types_elements = nullptr;
     if (contains_parameter_types) {
@@ -622,7 +1143,7 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoked(
         contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
     }
 
-    auto out = helper->FindMethodInvoked(method_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+    auto out = helper->FindMethodUsingType(class_index, static_cast<unsigned>(kinds), return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
 
     if (parameter_shorty_) {
         env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
@@ -645,9 +1166,9 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodInvoked(
     return res;
 }
 
-JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodSettingField(
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingNumber(
         JNIEnv *env, jobject thiz,
-        jlong field_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlong value, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
         jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
     auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
     if (!handler) {
@@ -675,7 +1196,7 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodSettingField
         contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
     }
 
-    auto out = helper->FindMethodSettingField(field_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+    auto out = helper->FindMethodUsingNumber(value, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
 
     if (parameter_shorty_) {
         env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
@@ -698,9 +1219,9 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodSettingField
     return res;
 }
 
-JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodGettingField(
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodUsingNumberRange(
         JNIEnv *env, jobject thiz,
-        jlong field_index, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
+        jlong lower, jlong upper, jlong return_type, jshort parameter_count, jstring parameter_shorty, jlong declaring_class,
         jlongArray parameter_types, jlongArray contains_parameter_types, jintArray dex_priority, jboolean find_first) {
     auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
     if (!handler) {
@@ -714,7 +1235,6 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodGettingField
         dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
         dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
     }
-
     std::vector<size_t> parameter_types_;
     jlong *parameter_types_elements = nullptr;
     if (parameter_types) {
@@ -729,7 +1249,7 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodGettingField
         contains_parameter_types_.assign(contains_parameter_types_elements, contains_parameter_types_elements + env->GetArrayLength(contains_parameter_types));
     }
 
-    auto out = helper->FindMethodGettingField(field_index, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
+    auto out = helper->FindMethodUsingNumberRange(lower, upper, return_type, parameter_count, parameter_shorty_ ? parameter_shorty_ : "", declaring_class, parameter_types_, contains_parameter_types_, dex_priority_, find_first);
 
     if (parameter_shorty_) {
         env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
@@ -752,6 +1272,48 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodGettingField
     return res;
 }
 
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findMethodBySignature(
+        JNIEnv *env, jobject thiz,
+        jlong return_type, jlongArray parameter_types, jstring parameter_shorty, jintArray dex_priority, jboolean find_first) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto parameter_shorty_ = parameter_shorty ? env->GetStringUTFChars(parameter_shorty, nullptr) : nullptr;
+    std::vector<size_t> dex_priority_;
+    jint *dex_priority_elements = nullptr;
+    if (dex_priority) {
+        dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+    }
+    std::vector<size_t> parameter_types_;
+    jlong *parameter_types_elements = nullptr;
+    if (parameter_types) {
+        parameter_types_elements = env->GetLongArrayElements(parameter_types, nullptr);
+        parameter_types_.assign(parameter_types_elements, parameter_types_elements + env->GetArrayLength(parameter_types));
+    }
+
+    auto out = helper->FindMethodBySignature(return_type, parameter_types_, parameter_shorty_ ? parameter_shorty_ : "", dex_priority_, find_first);
+
+    if (parameter_shorty_) {
+        env->ReleaseStringUTFChars(parameter_shorty, parameter_shorty_);
+    }
+    if (dex_priority_elements) {
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    if (parameter_types_elements) {
+        env->ReleaseLongArrayElements(parameter_types, parameter_types_elements, JNI_ABORT);
+    }
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
 JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findField(
         JNIEnv *env, jobject thiz,
         jlong type, jintArray dex_priority, jboolean find_first) {
@@ -780,6 +1342,57 @@ JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findField(
     return res;
 }
 
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findSubclasses(JNIEnv *env, jobject thiz, jlong class_index, jboolean transitive) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto out = helper->FindSubclasses(class_index, transitive);
+
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findImplementations(JNIEnv *env, jobject thiz, jlong interface_index) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto out = helper->FindImplementations(interface_index);
+
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
+JNIEXPORT jlongArray JNICALL Java_com_rarnu_dex_DexHelper_findSuperclasses(JNIEnv *env, jobject thiz, jlong class_index) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return env->NewLongArray(0);
+    }
+    auto &[helper, _] = *handler;
+    auto out = helper->FindSuperclasses(class_index);
+
+    auto res = env->NewLongArray(static_cast<int>(out.size()));
+    auto res_element = env->GetLongArrayElements(res, nullptr);
+    for (size_t i = 0; i < out.size(); ++i) {
+        res_element[i] = static_cast<jlong>(out[i]);
+    }
+    env->ReleaseLongArrayElements(res, res_element, 0);
+    return res;
+}
+
 JNIEXPORT jobject JNICALL Java_com_rarnu_dex_DexHelper_decodeMethodIndex(JNIEnv *env, jobject thiz, jlong method_index) {
     auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
     if (!handler) {
@@ -889,6 +1502,10 @@ JNIEXPORT jclass JNICALL Java_com_rarnu_dex_DexHelper_decodeClassIndex(JNIEnv *e
 JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_close(JNIEnv *env, jobject thiz) {
     auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
     env->SetLongField(thiz, token_field, jlong(0));
+    if (!handler) return;
+    // the helper, and its warmup thread, read the mapped dexs until destroyed, but the order
+    // tuple elements are destroyed in is up to the library
+    std::get<0>(*handler).reset();
     delete handler;
 }
 
@@ -934,5 +1551,92 @@ JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_createFullCache(JNIEnv *env,
         return;
     }
     auto &[helper, _] = *handler;
-    helper->CreateFullCache();
+    helper->CreateFullCache(std::max(std::thread::hardware_concurrency(), 1u));
+    auto before = helper->GetCacheMemoryUsage();
+    helper->Compact();
+    LOGD("search caches compacted from %zu to %zu bytes", before, helper->GetCacheMemoryUsage());
+}
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_createGlobalIndices(JNIEnv *env, jobject thiz) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return;
+    }
+    auto &[helper, _] = *handler;
+    helper->CreateGlobalIndices();
+}
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_startWarmup(JNIEnv *env, jobject thiz, jintArray dex_priority) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return;
+    }
+    auto &[helper, _] = *handler;
+    std::vector<size_t> dex_priority_;
+    if (dex_priority) {
+        auto dex_priority_elements = env->GetIntArrayElements(dex_priority, nullptr);
+        dex_priority_.assign(dex_priority_elements, dex_priority_elements + env->GetArrayLength(dex_priority));
+        env->ReleaseIntArrayElements(dex_priority, dex_priority_elements, JNI_ABORT);
+    }
+    helper->StartWarmup(dex_priority_);
+}
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_pauseWarmup(JNIEnv *env, jobject thiz) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return;
+    }
+    auto &[helper, _] = *handler;
+    helper->PauseWarmup();
+}
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_resumeWarmup(JNIEnv *env, jobject thiz) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return;
+    }
+    auto &[helper, _] = *handler;
+    helper->ResumeWarmup();
+}
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_cancelWarmup(JNIEnv *env, jobject thiz) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return;
+    }
+    auto &[helper, _] = *handler;
+    helper->CancelWarmup();
+}
+
+JNIEXPORT jfloat JNICALL Java_com_rarnu_dex_DexHelper_getWarmupProgress(JNIEnv *env, jobject thiz) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return 0;
+    }
+    auto &[helper, _] = *handler;
+    auto [done, total] = helper->GetWarmupProgress();
+    return total ? static_cast<jfloat>(done) / total : 0;
+}
+
+JNIEXPORT void JNICALL Java_com_rarnu_dex_DexHelper_compact(JNIEnv *env, jobject thiz) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler) {
+        return;
+    }
+    auto &[helper, _] = *handler;
+    auto before = helper->GetCacheMemoryUsage();
+    helper->Compact();
+    LOGD("search caches compacted from %zu to %zu bytes", before, helper->GetCacheMemoryUsage());
+}
+
+JNIEXPORT jboolean JNICALL Java_com_rarnu_dex_DexHelper_saveSnapshot(JNIEnv *env, jobject thiz, jstring path) {
+    auto *handler = reinterpret_cast<Handler *>(env->GetLongField(thiz, token_field));
+    if (!handler || !path) {
+        return JNI_FALSE;
+    }
+    auto &[helper, _] = *handler;
+    auto path_ = env->GetStringUTFChars(path, nullptr);
+    auto res = helper->SaveSnapshot(path_);
+    env->ReleaseStringUTFChars(path, path_);
+    return res;
 }